@@ -180,3 +180,13 @@ endif()
 
 set(CMAKE_REQUIRED_INCLUDES)
 set(CMAKE_REQUIRED_LIBRARIES)
+
+# mmap()-based file reading (checksum engine, file inputs)
+check_function_exists( "posix_madvise" HAVE_POSIX_MADVISE )
+
+# kernel-side file copies (moving decrypted files across file systems)
+check_function_exists( "copy_file_range" HAVE_COPY_FILE_RANGE )
+check_cxx_source_compiles("
+  #include <sys/sendfile.h>
+  int main() { return sendfile(1, 0, 0, 0) < 0; }
+" HAVE_LINUX_SENDFILE )
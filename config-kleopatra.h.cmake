@@ -26,3 +26,12 @@
 
 /* DBus available */
 #cmakedefine01 HAVE_QDBUS
+
+/* Define to 1 if you have the posix_madvise function */
+#cmakedefine HAVE_POSIX_MADVISE 1
+
+/* Define to 1 if you have the copy_file_range function */
+#cmakedefine HAVE_COPY_FILE_RANGE 1
+
+/* Define to 1 if you have the Linux sendfile function */
+#cmakedefine HAVE_LINUX_SENDFILE 1
@@ -35,15 +35,23 @@
 #include "importcertificatefromfilecommand.h"
 #include "importcertificatescommand_p.h"
 
+#include "fileoperationspreferences.h"
+
 #include "utils/filedialog.h"
+#include "utils/parallel.h"
 
 #include <QGpgME/Protocol>
 #include <QGpgME/ImportJob>
 
 #include <Libkleo/Classify>
 
+#include <gpgme++/context.h>
+#include <gpgme++/data.h>
 #include <gpgme++/global.h>
 #include <gpgme++/importresult.h>
+#include <gpgme++/interfaces/dataprovider.h>
+
+#include <gpg-error.h>
 
 #include <KLocalizedString>
 #include <KConfigGroup>
@@ -53,15 +61,141 @@
 #include <QWidget>
 #include <QFileInfo>
 #include <QDir>
+#include <QThread>
+#include <QAtomicInt>
+#include <QTimer>
 
 #include <KSharedConfig>
 
+#include <algorithm>
+#include <cstdio>
 #include <memory>
+#include <vector>
+
+#include <errno.h>
 
 using namespace GpgME;
 using namespace Kleo;
 using namespace QGpgME;
 
+namespace
+{
+
+// Hands gpgme the file piece by piece, reading straight into gpgme's
+// own (small) buffer, so the file never needs to be held in memory.
+class FileDataProvider : public GpgME::DataProvider
+{
+public:
+    FileDataProvider(QFile *file, const QAtomicInt *canceled, QAtomicInteger<qint64> *bytesRead)
+        : m_file(file), m_canceled(canceled), m_bytesRead(bytesRead) {}
+
+    bool isSupported(Operation op) const override
+    {
+        return op != Write;
+    }
+    ssize_t read(void *buffer, size_t bufSize) override
+    {
+        if (m_canceled->load()) {
+            errno = ECANCELED;
+            return -1;
+        }
+        errno = 0;
+        const qint64 n = m_file->read(static_cast<char *>(buffer), bufSize);
+        if (n < 0) {
+            // keep the reason read() failed with, if there is one
+            if (!errno) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        m_bytesRead->fetchAndAddRelaxed(n);
+        return n;
+    }
+    ssize_t write(const void *, size_t) override
+    {
+        errno = EBADF;
+        return -1;
+    }
+    off_t seek(off_t offset, int whence) override
+    {
+        qint64 newPos = offset;
+        if (whence == SEEK_CUR) {
+            newPos += m_file->pos();
+        } else if (whence == SEEK_END) {
+            newPos += m_file->size();
+        }
+        if (!m_file->seek(newPos)) {
+            errno = EINVAL;
+            return -1;
+        }
+        return newPos;
+    }
+    void release() override
+    {
+        m_file->close();
+    }
+
+private:
+    QFile *const m_file;
+    const QAtomicInt *const m_canceled;
+    QAtomicInteger<qint64> *const m_bytesRead;
+};
+
+class ImportFileThread : public QThread
+{
+public:
+    ImportFileThread(GpgME::Protocol protocol, const QString &fileName)
+        : QThread(), m_protocol(protocol), m_fileName(fileName), m_canceled(0), m_bytesRead(0) {}
+
+    QString fileName() const
+    {
+        return m_fileName;
+    }
+    GpgME::ImportResult importResult() const
+    {
+        return m_result;
+    }
+    void cancel()
+    {
+        m_canceled.store(1);
+    }
+    qint64 bytesRead() const
+    {
+        return m_bytesRead.load();
+    }
+
+protected:
+    void run() override
+    {
+        const std::unique_ptr<Context> ctx(Context::createForProtocol(m_protocol));
+        if (!ctx) {
+            m_result = ImportResult(Error(gpg_error(GPG_ERR_NOT_SUPPORTED)));
+            return;
+        }
+        QFile file(m_fileName);
+        errno = 0;
+        if (!file.open(QIODevice::ReadOnly)) {
+            m_result = ImportResult(Error(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO)));
+            return;
+        }
+        FileDataProvider dp(&file, &m_canceled, &m_bytesRead);
+        Data data(&dp);
+        m_result = ctx->importKeys(data);
+        if (m_canceled.load()) {
+            m_result = ImportResult(Error(gpg_error(GPG_ERR_CANCELED)));
+        }
+    }
+
+private:
+    const GpgME::Protocol m_protocol;
+    const QString m_fileName;
+    QAtomicInt m_canceled;
+    QAtomicInteger<qint64> m_bytesRead;
+    GpgME::ImportResult m_result;
+};
+
+}
+
 class ImportCertificateFromFileCommand::Private : public ImportCertificatesCommand::Private
 {
     friend class ::ImportCertificateFromFileCommand;
@@ -74,9 +208,21 @@ public:
     ~Private();
 
     bool ensureHaveFile();
+    void startNextImports();
+    void importFinished(ImportFileThread *thread);
+    void cancelImports();
+    void fileDone(const QString &fileName);
+    void emitProgress();
 
 private:
     QStringList files;
+    QStringList pendingFiles;
+    std::vector<ImportFileThread *> runningImports;
+    unsigned int maxRunningImports;
+    // progress in bytes read, over all files
+    qint64 totalBytes;
+    qint64 completedBytes;
+    QTimer progressTimer;
 };
 
 ImportCertificateFromFileCommand::Private *ImportCertificateFromFileCommand::d_func()
@@ -90,12 +236,29 @@ const ImportCertificateFromFileCommand::Private *ImportCertificateFromFileComman
 
 ImportCertificateFromFileCommand::Private::Private(ImportCertificateFromFileCommand *qq, KeyListController *c)
     : ImportCertificatesCommand::Private(qq, c),
-      files()
+      files(),
+      pendingFiles(),
+      runningImports(),
+      maxRunningImports(FileOperationsPreferences().maxConcurrentTasks()),
+      totalBytes(0),
+      completedBytes(0),
+      progressTimer()
 {
-
+    if (!maxRunningImports) {
+        maxRunningImports = defaultParallelism();
+    }
+    progressTimer.setInterval(250);
+    QObject::connect(&progressTimer, &QTimer::timeout, qq, [this]() { emitProgress(); });
 }
 
-ImportCertificateFromFileCommand::Private::~Private() {}
+ImportCertificateFromFileCommand::Private::~Private()
+{
+    cancelImports();
+    for (ImportFileThread *thread : runningImports) {
+        thread->wait();
+        delete thread;
+    }
+}
 
 #define d d_func()
 #define q q_func()
@@ -147,22 +310,88 @@ void ImportCertificateFromFileCommand::doStart()
 
     //TODO: use KIO here
     d->setWaitForMoreJobs(true);
+    d->pendingFiles = d->files;
+    d->totalBytes = 0;
+    d->completedBytes = 0;
     for (const QString &fn : qAsConst(d->files)) {
+        d->totalBytes += QFileInfo(fn).size();
+    }
+    d->progressTimer.start();
+    d->startNextImports();
+}
+
+void ImportCertificateFromFileCommand::doCancel()
+{
+    d->cancelImports();
+    ImportCertificatesCommand::doCancel();
+}
+
+void ImportCertificateFromFileCommand::Private::startNextImports()
+{
+    while (runningImports.size() < maxRunningImports && !pendingFiles.empty()) {
+        const QString fn = pendingFiles.takeFirst();
         QFile in(fn);
         if (!in.open(QIODevice::ReadOnly)) {
-            d->error(i18n("Could not open file %1 for reading: %2", in.fileName(), in.errorString()), i18n("Certificate Import Failed"));
-            d->importResult(ImportResult(), fn);
+            error(i18n("Could not open file %1 for reading: %2", in.fileName(), in.errorString()), i18n("Certificate Import Failed"));
+            fileDone(fn);
+            importResult(ImportResult(), fn);
             continue;
         }
         const GpgME::Protocol protocol = findProtocol(fn);
         if (protocol == GpgME::UnknownProtocol) {   //TODO: might use exceptions here
-            d->error(i18n("Could not determine certificate type of %1.", in.fileName()), i18n("Certificate Import Failed"));
-            d->importResult(ImportResult(), fn);
+            error(i18n("Could not determine certificate type of %1.", in.fileName()), i18n("Certificate Import Failed"));
+            fileDone(fn);
+            importResult(ImportResult(), fn);
             continue;
         }
-        d->startImport(protocol, in.readAll(), fn);
+        // the file is read by the import thread, in chunks
+        ImportFileThread *const thread = new ImportFileThread(protocol, fn);
+        QObject::connect(thread, &QThread::finished, q, [this, thread]() { importFinished(thread); });
+        runningImports.push_back(thread);
+        thread->start();
+    }
+    if (runningImports.empty() && pendingFiles.empty()) {
+        progressTimer.stop();
+        setWaitForMoreJobs(false);
+    }
+}
+
+void ImportCertificateFromFileCommand::Private::importFinished(ImportFileThread *thread)
+{
+    runningImports.erase(std::remove(runningImports.begin(), runningImports.end(), thread), runningImports.end());
+    const ImportResult result = thread->importResult();
+    const QString id = thread->fileName();
+    thread->deleteLater();
+    fileDone(id);
+    importResult(result, id);
+    startNextImports();
+}
+
+void ImportCertificateFromFileCommand::Private::fileDone(const QString &fileName)
+{
+    completedBytes += QFileInfo(fileName).size();
+    emitProgress();
+}
+
+void ImportCertificateFromFileCommand::Private::emitProgress()
+{
+    qint64 done = completedBytes;
+    for (const ImportFileThread *thread : runningImports) {
+        done += thread->bytesRead();
+    }
+    // in KiB, so that the int arguments do not overflow
+    Q_EMIT q->progress(i18n("Importing certificates..."),
+                       static_cast<int>(std::min(done, totalBytes) / 1024),
+                       static_cast<int>(totalBytes / 1024));
+}
+
+void ImportCertificateFromFileCommand::Private::cancelImports()
+{
+    progressTimer.stop();
+    pendingFiles.clear();
+    for (ImportFileThread *thread : runningImports) {
+        thread->cancel();
     }
-    d->setWaitForMoreJobs(false);
 }
 
 static QStringList get_file_name(QWidget *parent)
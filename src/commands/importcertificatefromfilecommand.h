@@ -56,6 +56,7 @@ public:
 
 private:
     void doStart() override;
+    void doCancel() override;
 
 private:
     class Private;
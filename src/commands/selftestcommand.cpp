@@ -49,12 +49,21 @@
 #include <selftest/gpgagentcheck.h>
 #include <selftest/libkleopatrarccheck.h>
 
+#include <utils/parallel.h>
+
 #include <Libkleo/Stl_Util>
 
+#include "kleopatra_debug.h"
 #include <KLocalizedString>
 #include <KConfigGroup>
 #include <KSharedConfig>
 
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+
+#include <functional>
+#include <memory>
 #include <vector>
 
 using namespace Kleo;
@@ -71,6 +80,99 @@ static const char *const components[] = {
 };
 static const unsigned int numComponents = sizeof components / sizeof * components;
 
+static QString componentName(const char *component)
+{
+    return component ? QLatin1String(component) : QStringLiteral("gpgconf");
+}
+
+namespace
+{
+
+// Runs the checks that only talk to GnuPG concurrently and off the GUI
+// thread, so that they don't hold up the initial key listing.
+// Configuration checks that passed for the same GnuPG installation and
+// configuration files before are not run again.
+class SelfTestRunner : public QThread
+{
+public:
+    SelfTestRunner(const QString &cachedFingerprint, const QStringList &cachedPasses)
+        : QThread(),
+          m_cachedFingerprint(cachedFingerprint),
+          m_cachedPasses(cachedPasses)
+    {
+    }
+
+    const std::vector< std::shared_ptr<SelfTest> > &tests() const
+    {
+        return m_tests;
+    }
+    QString fingerprint() const
+    {
+        return m_fingerprint;
+    }
+    QStringList passedConfigurationChecks() const
+    {
+        return m_passes;
+    }
+
+protected:
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        m_fingerprint = gpgConfCheckFingerprint();
+        const bool useCache = !m_cachedFingerprint.isEmpty() && m_fingerprint == m_cachedFingerprint;
+
+        std::vector< std::function<std::shared_ptr<SelfTest>()> > factories;
+        //Q_EMIT q->info( i18n("Checking gpg installation...") );
+        factories.push_back(&makeGpgEngineCheckSelfTest);
+        //Q_EMIT q->info( i18n("Checking gpgsm installation...") );
+        factories.push_back(&makeGpgSmEngineCheckSelfTest);
+        //Q_EMIT q->info( i18n("Checking gpgconf installation...") );
+        factories.push_back(&makeGpgConfEngineCheckSelfTest);
+        const size_t firstConfigurationCheck = factories.size();
+        int cached = 0;
+        for (unsigned int i = 0; i < numComponents; ++i) {
+            //Q_EMIT q->info( i18n("Checking %1 configuration...", components[i]) );
+            const char *const component = components[i];
+            if (useCache && m_cachedPasses.contains(componentName(component))) {
+                factories.push_back([component]() { return makeCachedGpgConfCheckConfigurationSelfTest(component); });
+                ++cached;
+            } else {
+                factories.push_back([component]() { return makeGpgConfCheckConfigurationSelfTest(component); });
+            }
+        }
+#ifndef Q_OS_WIN
+        factories.push_back(&makeGpgAgentConnectivitySelfTest);
+#endif
+
+        m_tests.resize(factories.size());
+        parallelFor(factories.size(), [this, &factories](int i) {
+            m_tests[i] = factories[i]();
+        });
+
+        for (unsigned int i = 0; i < numComponents; ++i) {
+            const std::shared_ptr<SelfTest> &test = m_tests[firstConfigurationCheck + i];
+            if (test->passed() && !test->skipped()) {
+                m_passes.push_back(componentName(components[i]));
+            }
+        }
+
+        qCDebug(KLEOPATRA_LOG) << "Self-test: ran" << m_tests.size() - cached << "checks," << cached
+                               << "cached, in" << timer.elapsed() << "ms";
+    }
+
+private:
+    const QString m_cachedFingerprint;
+    const QStringList m_cachedPasses;
+    QString m_fingerprint;
+    QStringList m_passes;
+    std::vector< std::shared_ptr<SelfTest> > m_tests;
+};
+
+}
+
 class SelfTestCommand::Private : Command::Private
 {
     friend class ::Kleo::Commands::SelfTestCommand;
@@ -129,6 +231,29 @@ private:
 
     void runTests()
     {
+        if (runner) {
+            // already running; the results will show up when it's done
+            return;
+        }
+        const KConfigGroup config(KSharedConfig::openConfig(), "Self-Test");
+        // an explicit re-run from the dialog checks everything again
+        runner.reset(new SelfTestRunner(dialog ? QString() : config.readEntry("gpgconf-checks-fingerprint", QString()),
+                                        config.readEntry("gpgconf-checks-passed", QStringList())));
+        connect(runner.get(), SIGNAL(finished()), q_func(), SLOT(slotTestsFinished()));
+        runner->start();
+    }
+
+    void slotTestsFinished()
+    {
+        const std::unique_ptr<SelfTestRunner> done = std::move(runner);
+        if (!done || canceled) {
+            return;
+        }
+
+        KConfigGroup config(KSharedConfig::openConfig(), "Self-Test");
+        config.writeEntry("gpgconf-checks-fingerprint", done->fingerprint());
+        config.writeEntry("gpgconf-checks-passed", done->passedConfigurationChecks());
+
         std::vector< std::shared_ptr<Kleo::SelfTest> > tests;
 
 #if defined(Q_OS_WIN)
@@ -139,19 +264,7 @@ private:
         tests.push_back(makeUiServerConnectivitySelfTest());
 #endif
 #endif
-        //Q_EMIT q->info( i18n("Checking gpg installation...") );
-        tests.push_back(makeGpgEngineCheckSelfTest());
-        //Q_EMIT q->info( i18n("Checking gpgsm installation...") );
-        tests.push_back(makeGpgSmEngineCheckSelfTest());
-        //Q_EMIT q->info( i18n("Checking gpgconf installation...") );
-        tests.push_back(makeGpgConfEngineCheckSelfTest());
-        for (unsigned int i = 0; i < numComponents; ++i) {
-            //Q_EMIT q->info( i18n("Checking %1 configuration...", components[i]) );
-            tests.push_back(makeGpgConfCheckConfigurationSelfTest(components[i]));
-        }
-#ifndef Q_OS_WIN
-        tests.push_back(makeGpgAgentConnectivitySelfTest());
-#endif
+        tests.insert(tests.end(), done->tests().begin(), done->tests().end());
         tests.push_back(makeLibKleopatraRcSelfTest());
 
         if (!dialog && std::none_of(tests.cbegin(), tests.cend(),
@@ -192,6 +305,7 @@ private:
 
 private:
     QPointer<SelfTestDialog> dialog;
+    std::unique_ptr<SelfTestRunner> runner;
     bool canceled;
     bool automatic;
 };
@@ -211,6 +325,7 @@ const SelfTestCommand::Private *SelfTestCommand::d_func() const
 SelfTestCommand::Private::Private(SelfTestCommand *qq, KeyListController *c)
     : Command::Private(qq, c),
       dialog(),
+      runner(),
       canceled(false),
       automatic(false)
 {
@@ -219,7 +334,10 @@ SelfTestCommand::Private::Private(SelfTestCommand *qq, KeyListController *c)
 
 SelfTestCommand::Private::~Private()
 {
-
+    if (runner) {
+        // the checks can't be interrupted, but they don't take long
+        runner->wait();
+    }
 }
 
 SelfTestCommand::SelfTestCommand(KeyListController *c)
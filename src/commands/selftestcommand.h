@@ -63,6 +63,7 @@ private:
     Q_PRIVATE_SLOT(d_func(), void slotUpdateRequested())
     Q_PRIVATE_SLOT(d_func(), void slotDialogAccepted())
     Q_PRIVATE_SLOT(d_func(), void slotDialogRejected())
+    Q_PRIVATE_SLOT(d_func(), void slotTestsFinished())
 };
 
 }
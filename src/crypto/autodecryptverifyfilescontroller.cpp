@@ -51,20 +51,33 @@
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
 #include <utils/archivedefinition.h>
+#include <utils/parallel.h>
 
 #include <Libkleo/Classify>
+#include <Libkleo/Exception>
 
 #include <KLocalizedString>
 #include <KMessageBox>
 #include "kleopatra_debug.h"
 
 #include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <QProgressDialog>
+#include <QThread>
 #include <QTimer>
 #include <QFileDialog>
 #include <QTemporaryDir>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -73,6 +86,90 @@ using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace Kleo::Crypto::Gui;
 
+namespace
+{
+struct PendingMove {
+    QString from;
+    QString to;
+    bool isDir;
+};
+
+// Moves the results out of the work directory. Within one file system
+// that is just a rename; otherwise the data is copied by the kernel,
+// which may take a while for big archives.
+class MoveResultsThread : public QThread
+{
+public:
+    explicit MoveResultsThread(const std::vector<PendingMove> &moves)
+        : QThread(), m_moves(moves), m_bytesMoved(0), m_canceled(0) {}
+
+    qint64 bytesMoved() const
+    {
+        return m_bytesMoved.load();
+    }
+    void cancel()
+    {
+        m_canceled.store(1);
+    }
+    // the moves that failed, with an error message (may be empty)
+    const std::vector<std::pair<PendingMove, QString> > &failures() const
+    {
+        return m_failures;
+    }
+
+protected:
+    void run() override
+    {
+        qint64 done = 0;
+        const CopyProgress progress = [this, &done](qint64 copied) {
+            m_bytesMoved.store(done + copied);
+            return !m_canceled.load();
+        };
+        for (const PendingMove &move : m_moves) {
+            qCDebug(KLEOPATRA_LOG) << "Moving " << move.from << " to " << move.to;
+            QString errorString;
+            bool ok = false;
+            if (m_canceled.load()) {
+                errorString = i18n("Operation canceled.");
+            } else if (move.isDir) {
+                try {
+                    ok = moveDir(move.from, move.to, progress);
+                } catch (const Kleo::Exception &e) {
+                    errorString = e.message();
+                }
+            } else {
+                ok = moveFile(move.from, move.to, &errorString, progress);
+            }
+            if (!ok) {
+                m_failures.push_back(std::make_pair(move, errorString));
+            }
+            done = m_bytesMoved.load();
+        }
+    }
+
+private:
+    const std::vector<PendingMove> m_moves;
+    std::atomic<qint64> m_bytesMoved;
+    QAtomicInt m_canceled;
+    std::vector<std::pair<PendingMove, QString> > m_failures;
+};
+
+qint64 totalSize(const QString &path)
+{
+    const QFileInfo fi(path);
+    if (!fi.isDir()) {
+        return fi.size();
+    }
+    qint64 result = 0;
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        result += it.fileInfo().size();
+    }
+    return result;
+}
+}
+
 class AutoDecryptVerifyFilesController::Private
 {
     AutoDecryptVerifyFilesController *const q;
@@ -87,6 +184,7 @@ public:
     void schedule();
 
     void exec();
+    void moveResults(const std::vector<PendingMove> &moves);
     std::vector<std::shared_ptr<Task> > buildTasks(const QStringList &, QStringList &);
 
     struct CryptoFile {
@@ -107,8 +205,11 @@ public:
 
     QStringList m_passedFiles, m_filesAfterPreparation;
     std::vector<std::shared_ptr<const DecryptVerifyResult> > m_results;
-    std::vector<std::shared_ptr<Task> > m_runnableTasks, m_completedTasks;
-    std::shared_ptr<Task> m_runningTask;
+    std::vector<std::shared_ptr<Task> > m_runnableTasks, m_runningTasks, m_completedTasks;
+    // task -> task producing its input, which must complete first
+    std::map<const Task *, std::shared_ptr<Task> > m_prerequisites;
+    std::weak_ptr<TaskCollection> m_taskCollection;
+    unsigned int m_maxRunningTasks;
     bool m_errorDetected;
     DecryptVerifyOperation m_operation;
     DecryptVerifyFilesDialog *m_dialog;
@@ -122,6 +223,10 @@ AutoDecryptVerifyFilesController::Private::Private(AutoDecryptVerifyFilesControl
     m_workDir(nullptr)
 {
     qRegisterMetaType<VerificationResult>();
+    m_maxRunningTasks = FileOperationsPreferences().maxConcurrentTasks();
+    if (!m_maxRunningTasks) {
+        m_maxRunningTasks = defaultParallelism();
+    }
 }
 
 void AutoDecryptVerifyFilesController::Private::slotDialogCanceled()
@@ -131,13 +236,20 @@ void AutoDecryptVerifyFilesController::Private::slotDialogCanceled()
 
 void AutoDecryptVerifyFilesController::Private::schedule()
 {
-    if (!m_runningTask && !m_runnableTasks.empty()) {
+    while (m_runningTasks.size() < m_maxRunningTasks && !m_runnableTasks.empty()) {
         const std::shared_ptr<Task> t = m_runnableTasks.back();
+        const auto prereq = m_prerequisites.find(t.get());
+        if (prereq != m_prerequisites.end()) {
+            if (std::find(m_completedTasks.cbegin(), m_completedTasks.cend(), prereq->second) == m_completedTasks.cend()) {
+                break;
+            }
+            m_prerequisites.erase(prereq);
+        }
         m_runnableTasks.pop_back();
+        m_runningTasks.push_back(t);
         t->start();
-        m_runningTask = t;
     }
-    if (!m_runningTask) {
+    if (m_runningTasks.empty()) {
         kleo_assert(m_runnableTasks.empty());
         for (const std::shared_ptr<const DecryptVerifyResult> &i : qAsConst(m_results)) {
             Q_EMIT q->verificationResult(i->verificationResult());
@@ -173,7 +285,11 @@ void AutoDecryptVerifyFilesController::Private::exec()
     Q_FOREACH (const std::shared_ptr<Task> &i, m_runnableTasks) {
         q->connectTask(i);
     }
+    coll->setEmitResultsInTaskOrder(true);
     coll->setTasks(m_runnableTasks);
+    // schedule() pops from the back, start with the first file
+    std::reverse(m_runnableTasks.begin(), m_runnableTasks.end());
+    m_taskCollection = coll;
     m_dialog = new DecryptVerifyFilesDialog(coll);
     m_dialog->setOutputLocation(heuristicBaseDirectory(m_passedFiles));
 
@@ -183,6 +299,7 @@ void AutoDecryptVerifyFilesController::Private::exec()
         const QDir workdir(m_workDir->path());
         const QDir outDir(m_dialog->outputLocation());
         bool overWriteAll = false;
+        std::vector<PendingMove> moves;
         qCDebug(KLEOPATRA_LOG) << workdir.entryList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
         for (const QFileInfo &fi: workdir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot)) {
             const auto inpath = fi.absoluteFilePath();
@@ -208,15 +325,10 @@ void AutoDecryptVerifyFilesController::Private::exec()
                     suffix = QStringLiteral("_%1").arg(++i);
                 } while (i < 1000);
 
-                if (!moveDir(inpath, ofi.absoluteFilePath())) {
-                    reportError(makeGnuPGError(GPG_ERR_GENERAL),
-                            xi18n("Failed to move <filename>%1</filename> to <filename>%2</filename>.",
-                                  inpath, ofi.absoluteFilePath()));
-                }
+                moves.push_back({ inpath, ofi.absoluteFilePath(), true });
                 continue;
             }
             const auto outpath = outDir.absoluteFilePath(fi.fileName());
-            qCDebug(KLEOPATRA_LOG) << "Moving " << inpath << " to " << outpath;
             const QFileInfo ofi(outpath);
             if (ofi.exists()) {
                 int sel = KMessageBox::No;
@@ -235,25 +347,55 @@ void AutoDecryptVerifyFilesController::Private::exec()
                 if (sel == KMessageBox::No) { //Overwrite All
                     overWriteAll = true;
                 }
-                if (!QFile::remove(outpath)) {
-                    reportError(makeGnuPGError(GPG_ERR_GENERAL),
-                                xi18n("Failed to delete <filename>%1</filename>.",
-                                      outpath));
-                    continue;
-                }
-            }
-            if (!QFile::rename(inpath, outpath)) {
-                reportError(makeGnuPGError(GPG_ERR_GENERAL),
-                            xi18n("Failed to move <filename>%1</filename> to <filename>%2</filename>.",
-                                  inpath, outpath));
+                // moveFile() replaces the existing file in one step
             }
+            moves.push_back({ inpath, outpath, false });
         }
+        moveResults(moves);
     }
     q->emitDoneOrError();
     delete m_dialog;
     m_dialog = nullptr;
 }
 
+void AutoDecryptVerifyFilesController::Private::moveResults(const std::vector<PendingMove> &moves)
+{
+    if (moves.empty()) {
+        return;
+    }
+    qint64 total = 0;
+    for (const PendingMove &move : moves) {
+        total += totalSize(move.from);
+    }
+
+    MoveResultsThread thread(moves);
+    // only shows up if the move takes long, i.e. needs copying
+    QProgressDialog progress(i18n("Moving decrypted files to their destination..."), i18n("Cancel"), 0, 1000, m_dialog);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, &progress, [&progress, &thread, total]() {
+        progress.setValue(total > 0 ? static_cast<int>(thread.bytesMoved() * 1000 / total) : 0);
+    });
+    QObject::connect(&progress, &QProgressDialog::canceled, &progress, [&thread]() {
+        thread.cancel();
+    });
+    QEventLoop loop;
+    QObject::connect(&thread, &QThread::finished, &loop, &QEventLoop::quit);
+    timer.start(100);
+    thread.start();
+    loop.exec();
+    timer.stop();
+    progress.reset();
+
+    for (const auto &failure : thread.failures()) {
+        const QString msg = xi18n("Failed to move <filename>%1</filename> to <filename>%2</filename>.",
+                                  failure.first.from, failure.first.to);
+        reportError(makeGnuPGError(GPG_ERR_GENERAL),
+                    failure.second.isEmpty() ? msg : msg + QLatin1Char(' ') + failure.second);
+    }
+}
+
 QVector<AutoDecryptVerifyFilesController::Private::CryptoFile> AutoDecryptVerifyFilesController::Private::classifyAndSortFiles(const QStringList &files)
 {
     const auto isSignature = [](int classification) -> bool {
@@ -262,37 +404,59 @@ QVector<AutoDecryptVerifyFilesController::Private::CryptoFile> AutoDecryptVerify
                 || (classification & Class::TypeMask) == Class::ClearsignedMessage;
     };
 
-    QVector<CryptoFile> out;
-    for (const auto &file : files) {
-        CryptoFile cFile;
-        cFile.fileName = file;
-        cFile.baseName = file.left(file.length() - 4);
-        cFile.classification = classify(file);
+    QElapsedTimer timer;
+    timer.start();
+
+    // Content sniffing reads the start of every file; do that in parallel.
+    QVector<CryptoFile> classified(files.size());
+    CryptoFile *const entries = classified.data(); // detach before going parallel
+    parallelFor(files.size(), [&files, entries](int i) {
+        CryptoFile &cFile = entries[i];
+        cFile.fileName = files[i];
+        cFile.baseName = cFile.fileName.left(cFile.fileName.length() - 4);
+        cFile.classification = classify(cFile.fileName);
         cFile.protocol = findProtocol(cFile.classification);
-
-        auto it = std::find_if(out.begin(), out.end(),
-                               [&cFile](const CryptoFile &other) {
-                                    return other.protocol == cFile.protocol
-                                            && other.baseName == cFile.baseName;
-                               });
-        if (it != out.end()) {
-            // If we found a file with the same basename, make sure that encrypted
-            // file is before the signature file, so that we first decrypt and then
-            // verify
-            if (isSignature(cFile.classification) && isCipherText(it->classification)) {
-                out.insert(it + 1, cFile);
-            } else if (isCipherText(cFile.classification) && isSignature(it->classification)) {
-                out.insert(it, cFile);
-            } else {
-                // both are signatures or both are encrypted files, in which
-                // case order does not matter
-                out.insert(it, cFile);
-            }
+    });
+    const qint64 classifyTime = timer.restart();
+
+    // Files with the same protocol and base name are kept together, in
+    // the order of the first file of each group. Within a group, a new
+    // file goes right before the first one, or right after it if it is
+    // a signature for encrypted data, so that we first decrypt and then
+    // verify. Both insert positions are O(1) on a deque.
+    QHash<QPair<int, QString>, int> groupIndex;
+    std::vector<std::deque<int> > groups;
+    groupIndex.reserve(classified.size());
+    for (int i = 0; i < classified.size(); ++i) {
+        const CryptoFile &cFile = classified[i];
+        const QPair<int, QString> key(cFile.protocol, cFile.baseName);
+        const auto it = groupIndex.constFind(key);
+        if (it == groupIndex.constEnd()) {
+            groupIndex.insert(key, static_cast<int>(groups.size()));
+            groups.push_back(std::deque<int>(1, i));
+            continue;
+        }
+        std::deque<int> &group = groups[it.value()];
+        const CryptoFile &first = classified[group.front()];
+        if (isSignature(cFile.classification) && isCipherText(first.classification)) {
+            group.insert(group.begin() + 1, i);
         } else {
-            out.push_back(cFile);
+            // the encrypted file goes before the signature; if both are
+            // signatures or both are encrypted files, order does not matter
+            group.push_front(i);
+        }
+    }
+
+    QVector<CryptoFile> out;
+    out.reserve(classified.size());
+    for (const std::deque<int> &group : groups) {
+        for (int i : group) {
+            out.push_back(classified[i]);
         }
     }
 
+    qCDebug(KLEOPATRA_LOG) << "classified" << files.size() << "files in" << classifyTime << "ms,"
+                           << "paired them into" << groups.size() << "groups in" << timer.elapsed() << "ms";
     return out;
 }
 
@@ -330,12 +494,12 @@ std::vector< std::shared_ptr<Task> > AutoDecryptVerifyFilesController::Private::
             // First, see if previous task was a decryption task for the same file
             // and "pipe" it's output into our input
             std::shared_ptr<Input> input;
-            bool prepend = false;
+            bool fromPreviousOutput = false;
             if (it != cryptoFiles.begin()) {
                 const auto prev = it - 1;
                 if (prev->protocol == cFile.protocol && prev->baseName == cFile.baseName) {
                     input = Input::createFromOutput(prev->output);
-                    prepend = true;
+                    fromPreviousOutput = true;
                 }
             }
 
@@ -351,13 +515,13 @@ std::vector< std::shared_ptr<Task> > AutoDecryptVerifyFilesController::Private::
                 t->setInput(Input::createFromFile(cFile.fileName));
                 t->setSignedData(input);
                 t->setProtocol(cFile.protocol);
-                if (prepend) {
-                    // Put the verify task BEFORE the decrypt task in the tasks queue,
-                    // because the tasks are executed in reverse order!
-                    tasks.insert(tasks.end() - 1, t);
-                } else {
-                    tasks.push_back(t);
+                if (fromPreviousOutput && !tasks.empty()) {
+                    // The verify task reads the output of the decrypt task
+                    // queued just before it, so it must not start before
+                    // that one has finished.
+                    m_prerequisites[t.get()] = tasks.back();
                 }
+                tasks.push_back(t);
                 continue;
             } else {
                 // No signed data, maybe not a detached signature
@@ -505,12 +669,17 @@ void AutoDecryptVerifyFilesController::Private::cancelAllTasks()
 {
 
     // we just kill all runnable tasks - this will not result in
-    // signal emissions.
+    // signal emissions, so the collection must not wait for them.
+    if (const std::shared_ptr<TaskCollection> coll = m_taskCollection.lock()) {
+        coll->abandonTasks(m_runnableTasks);
+    }
     m_runnableTasks.clear();
+    m_prerequisites.clear();
 
     // a cancel() will result in a call to
-    if (m_runningTask) {
-        m_runningTask->cancel();
+    const std::vector<std::shared_ptr<Task> > running = m_runningTasks;
+    for (const std::shared_ptr<Task> &t : running) {
+        t->cancel();
     }
 }
 
@@ -531,15 +700,19 @@ void AutoDecryptVerifyFilesController::cancel()
 void AutoDecryptVerifyFilesController::doTaskDone(const Task *task, const std::shared_ptr<const Task::Result> &result)
 {
     Q_ASSERT(task);
-    Q_UNUSED(task);
 
     // We could just delete the tasks here, but we can't use
     // Qt::QueuedConnection here (we need sender()) and other slots
     // might not yet have executed. Therefore, we push completed tasks
     // into a burial container
 
-    d->m_completedTasks.push_back(d->m_runningTask);
-    d->m_runningTask.reset();
+    const std::vector<std::shared_ptr<Task> >::iterator it
+        = std::find_if(d->m_runningTasks.begin(), d->m_runningTasks.end(),
+                       [task](const std::shared_ptr<Task> &t) { return t.get() == task; });
+    if (it != d->m_runningTasks.end()) {
+        d->m_completedTasks.push_back(*it);
+        d->m_runningTasks.erase(it);
+    }
 
     if (const std::shared_ptr<const DecryptVerifyResult> &dvr = std::dynamic_pointer_cast<const DecryptVerifyResult>(result)) {
         d->m_results.push_back(dvr);
@@ -34,9 +34,12 @@
 
 #include "createchecksumscontroller.h"
 
+#include <utils/checksumengine.h>
+#include <utils/checksumscanner.h>
 #include <utils/input.h>
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
+#include <utils/parallel.h>
 
 #include <Libkleo/Stl_Util>
 #include <Libkleo/ChecksumDefinition>
@@ -64,7 +67,7 @@
 
 #include <gpg-error.h>
 
-#include <deque>
+#include <atomic>
 #include <map>
 #include <limits>
 #include <functional>
@@ -186,31 +189,6 @@ static QStringList fs_intersect(QStringList l1, QStringList l2)
     return result;
 }
 
-static QList<QRegExp> get_patterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    QList<QRegExp> result;
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                result.push_back(QRegExp(pattern, fs_cs));
-            }
-    return result;
-}
-
-namespace
-{
-
-struct matches_any : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_any(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::any_of(m_regexps.cbegin(), m_regexps.cend(),
-                           [s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-}
-
 class CreateChecksumsController::Private : public QThread
 {
     Q_OBJECT
@@ -317,9 +295,10 @@ void CreateChecksumsController::setFiles(const QStringList &files)
 {
     kleo_assert(!d->isRunning());
     kleo_assert(!files.empty());
-    const QList<QRegExp> patterns = get_patterns(d->checksumDefinitions);
-    if (!std::all_of(files.cbegin(), files.cend(), matches_any(patterns)) &&
-            !std::none_of(files.cbegin(), files.cend(), matches_any(patterns))) {
+    const ChecksumFilePatterns patterns(d->checksumDefinitions);
+    const auto isSumFile = [&patterns](const QString &file) { return patterns.matches(file); };
+    if (!std::all_of(files.cbegin(), files.cend(), isSumFile) &&
+            !std::none_of(files.cbegin(), files.cend(), isSumFile)) {
         throw Exception(gpg_error(GPG_ERR_INV_ARG), i18n("Create Checksums: input files must be either all checksum files or all files to be checksummed, not a mixture of both."));
     }
     const QMutexLocker locker(&d->mutex);
@@ -383,19 +362,6 @@ struct Dir {
 
 }
 
-static QStringList remove_checksum_files(QStringList l, const QList<QRegExp> &rxs)
-{
-    QStringList::iterator end = l.end();
-    for (const QRegExp &rx : rxs) {
-        end = std::remove_if(l.begin(), end,
-                             [rx](const QString &str) { 
-                                return rx.exactMatch(str);
-                             });
-    }
-    l.erase(end, l.end());
-    return l;
-}
-
 namespace
 {
 struct File {
@@ -454,36 +420,23 @@ static std::vector<File> parse_sum_file(const QString &fileName)
     return files;
 }
 
-static quint64 aggregate_size(const QDir &dir, const QStringList &files)
-{
-    quint64 n = 0;
-    for (const QString &file : files) {
-        n += QFileInfo(dir.absoluteFilePath(file)).size();
-    }
-    return n;
-}
-
-static std::shared_ptr<ChecksumDefinition> filename2definition(const QString &fileName,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions) {
-        if (cd) {
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                if (QRegExp(pattern, fs_cs).exactMatch(fileName)) {
-                    return cd;
-                }
-            }
-        }
-    }
-    return std::shared_ptr<ChecksumDefinition>();
-}
-
 static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool allowAddition,
         const std::function<void(int)> &progress,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+        const ChecksumFilePatterns &patterns)
 {
 
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
+    QStringList parentDirs;
+    for (const QString &file : files) {
+        const QString parent = QFileInfo(file).absolutePath();
+        if (!parentDirs.contains(parent)) {
+            parentDirs.push_back(parent);
+        }
+    }
+    const std::vector<DirectoryListing> listings = scanDirectories(parentDirs, false);
+    std::map<QString, const DirectoryListing *> listingsByPath;
+    for (const DirectoryListing &listing : listings) {
+        listingsByPath[listing.path] = &listing;
+    }
 
     std::vector<Dir> dirs;
     dirs.reserve(files.size());
@@ -494,7 +447,8 @@ static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool al
 
         const QFileInfo fi(file);
         const QDir dir = fi.dir();
-        const QStringList entries = remove_checksum_files(dir.entryList(QDir::Files), patterns);
+        const DirectoryListing &listing = *listingsByPath.at(fi.absolutePath());
+        const QStringList entries = patterns.withoutSumFiles(listing.files);
 
         QStringList inputFiles;
         if (allowAddition) {
@@ -512,8 +466,8 @@ static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool al
             dir,
             fi.fileName(),
             inputFiles,
-            aggregate_size(dir, inputFiles),
-            filename2definition(fi.fileName(), checksumDefinitions)
+            listing.totalSize(inputFiles),
+            patterns.definition(fi.fileName())
         };
 
         dirs.push_back(item);
@@ -538,38 +492,36 @@ struct less_dir : std::binary_function<QDir, QDir, bool> {
 
 static std::vector<Dir> find_dirs_by_input_files(const QStringList &files, const std::shared_ptr<ChecksumDefinition> &checksumDefinition, bool allowAddition,
         const std::function<void(int)> &progress,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+        const ChecksumFilePatterns &patterns)
 {
     Q_UNUSED(allowAddition);
     if (!checksumDefinition) {
         return std::vector<Dir>();
     }
 
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
-
     std::map<QDir, QStringList, less_dir> dirs2files;
 
     // Step 1: sort files by the dir they're contained in:
 
-    std::deque<QString> inputs(files.begin(), files.end());
-
-    int i = 0;
-    while (!inputs.empty()) {
-        const QString file = inputs.front();
-        inputs.pop_front();
-        const QFileInfo fi(file);
-        if (fi.isDir()) {
-            QDir dir(file);
-            dirs2files[ dir ] = remove_checksum_files(dir.entryList(QDir::Files), patterns);
-            const auto entryList = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-            std::transform(entryList.cbegin(), entryList.cend(),
-                           std::inserter(inputs, inputs.begin()),
-                           [&dir](const QString &entry) {
-                               return dir.absoluteFilePath(entry);
-                           });
+    QStringList inputDirs, plainFiles;
+    for (const QString &file : files) {
+        if (QFileInfo(file).isDir()) {
+            inputDirs.push_back(file);
         } else {
-            dirs2files[fi.dir()].push_back(file);
+            plainFiles.push_back(file);
         }
+    }
+
+    const std::vector<DirectoryListing> listings = scanDirectories(inputDirs, true, progress);
+    int i = listings.size();
+    std::map<QString, const DirectoryListing *> listingsByPath;
+    for (const DirectoryListing &listing : listings) {
+        dirs2files[ QDir(listing.path) ] = patterns.withoutSumFiles(listing.files);
+        listingsByPath[listing.path] = &listing;
+    }
+
+    for (const QString &file : plainFiles) {
+        dirs2files[QFileInfo(file).dir()].push_back(file);
         if (progress) {
             progress(++i);
         }
@@ -582,16 +534,21 @@ static std::vector<Dir> find_dirs_by_input_files(const QStringList &files, const
 
     for (std::map<QDir, QStringList, less_dir>::const_iterator it = dirs2files.begin(), end = dirs2files.end(); it != end; ++it) {
 
-        const QStringList inputFiles = remove_checksum_files(it->second, patterns);
+        const QStringList inputFiles = patterns.withoutSumFiles(it->second);
         if (inputFiles.empty()) {
             continue;
         }
 
+        // only given files were added to directories we did not scan
+        const auto listing = listingsByPath.find(it->first.absolutePath());
+        DirectoryListing unscanned;
+        unscanned.path = it->first.absolutePath();
+
         const Dir dir = {
             it->first,
             checksumDefinition->outputFileName(),
             inputFiles,
-            aggregate_size(it->first, inputFiles),
+            (listing != listingsByPath.end() ? *listing->second : unscanned).totalSize(inputFiles),
             checksumDefinition
         };
         dirs.push_back(dir);
@@ -678,11 +635,13 @@ void CreateChecksumsController::Private::run()
     const QString scanning = i18n("Scanning directories...");
     Q_EMIT progress(0, 0, scanning);
 
-    const bool haveSumFiles = std::all_of(files.cbegin(), files.cend(), matches_any(get_patterns(checksumDefinitions)));
+    const ChecksumFilePatterns patterns(checksumDefinitions);
+    const bool haveSumFiles = std::all_of(files.cbegin(), files.cend(),
+                                          [&patterns](const QString &file) { return patterns.matches(file); });
     const auto progressCb = [this, &scanning](int c) { Q_EMIT progress(c, 0, scanning); };
     const std::vector<Dir> dirs = haveSumFiles
-                                  ? find_dirs_by_sum_files(files, allowAddition, progressCb, checksumDefinitions)
-                                  : find_dirs_by_input_files(files, checksumDefinition, allowAddition, progressCb, checksumDefinitions);
+                                  ? find_dirs_by_sum_files(files, allowAddition, progressCb, patterns)
+                                  : find_dirs_by_input_files(files, checksumDefinition, allowAddition, progressCb, patterns);
 
     for (const Dir &dir : dirs) {
         qCDebug(KLEOPATRA_LOG) << dir;
@@ -705,8 +664,92 @@ void CreateChecksumsController::Private::run()
             // re-scale 'total' to fit into ints (wish QProgressDialog would use quint64...)
             const quint64 factor = total / std::numeric_limits<int>::max() + 1;
 
-            quint64 done = 0;
-            Q_FOREACH (const Dir &dir, dirs) {
+            // Step 2a: hash everything we can do ourselves on all cores:
+
+            std::map<std::shared_ptr<ChecksumDefinition>, ChecksumEngine> engines;
+            for (const Dir &dir : dirs) {
+                engines.emplace(dir.checksumDefinition, ChecksumEngine(dir.checksumDefinition));
+            }
+
+            struct HashJob {
+                size_t dir;   // index into dirs
+                int file;     // index into dirs[dir].inputFiles
+                QString path; // absolute, precomputed here, since QDir isn't safe to share across threads
+            };
+            std::vector<HashJob> jobs;
+            std::vector<QString> labels(dirs.size());
+            std::vector< std::vector<QByteArray> > checksums(dirs.size());
+            for (size_t i = 0, end = dirs.size(); i != end; ++i) {
+                const Dir &dir = dirs[i];
+                if (!engines.at(dir.checksumDefinition).canCreate()) {
+                    continue;
+                }
+                labels[i] = i18n("Checksumming (%2) in %1", dir.checksumDefinition->label(), dir.dir.path());
+                checksums[i].resize(dir.inputFiles.size());
+                for (int j = 0, jend = dir.inputFiles.size(); j != jend; ++j) {
+                    const HashJob job = { i, j, dir.dir.absoluteFilePath(dir.inputFiles[j]) };
+                    jobs.push_back(job);
+                }
+            }
+
+            std::vector<QString> dirErrors(dirs.size());
+            QMutex dirErrorsMutex;
+
+            std::atomic<quint64> hashed(0);
+            std::atomic<int> lastPermille(-1);
+            parallelFor(static_cast<int>(jobs.size()), [&](int idx) {
+                if (canceled) {
+                    return;
+                }
+                const HashJob &job = jobs[idx];
+                const ChecksumEngine &engine = engines.at(dirs[job.dir].checksumDefinition);
+                QString error;
+                const QByteArray checksum = engine.checksum(job.path, &error, [&](quint64 n) {
+                    // only emit when the per-mille value changes, so a pool
+                    // full of workers doesn't flood the GUI thread:
+                    const quint64 done = hashed += n;
+                    const int permille = total ? static_cast<int>(done * 1000 / total) : 1000;
+                    int last = lastPermille;
+                    if (permille > last && lastPermille.compare_exchange_strong(last, permille)) {
+                        Q_EMIT progress(done / factor, total / factor, labels[job.dir]);
+                    }
+                }, &canceled);
+                if (!checksum.isNull()) {
+                    checksums[job.dir][job.file] = checksum;
+                } else if (!canceled) {
+                    const QMutexLocker errorLocker(&dirErrorsMutex);
+                    if (dirErrors[job.dir].isEmpty()) {
+                        dirErrors[job.dir] = error;
+                    }
+                }
+            });
+
+            // Step 2b: write the sum files in order, running the external
+            // command for all definitions we don't implement ourselves:
+
+            quint64 done = hashed;
+            for (size_t i = 0, end = dirs.size(); i != end && !canceled; ++i) {
+                const Dir &dir = dirs[i];
+                if (engines.at(dir.checksumDefinition).canCreate()) {
+                    if (!dirErrors[i].isEmpty()) {
+                        errors.push_back(dirErrors[i]);
+                        continue;
+                    }
+                    std::vector< std::pair<QString, QByteArray> > entries;
+                    entries.reserve(dir.inputFiles.size());
+                    for (int j = 0, jend = dir.inputFiles.size(); j != jend; ++j) {
+                        entries.push_back(std::make_pair(dir.inputFiles[j], checksums[i][j]));
+                    }
+                    const QString absFilePath = dir.dir.absoluteFilePath(dir.sumFile);
+                    QString error;
+                    if (ChecksumEngine::writeSumFile(absFilePath, entries, &error)) {
+                        created.push_back(absFilePath);
+                    } else {
+                        qCDebug(KLEOPATRA_LOG) << "writing" << absFilePath << "failed:" << error;
+                        errors.push_back(xi18n("Failed to overwrite <filename>%1</filename>.", dir.sumFile));
+                    }
+                    continue;
+                }
                 Q_EMIT progress(done / factor, total / factor,
                                 i18n("Checksumming (%2) in %1", dir.checksumDefinition->label(), dir.dir.path()));
                 bool fatal = false;
@@ -717,7 +760,7 @@ void CreateChecksumsController::Private::run()
                     created.push_back(dir.dir.absoluteFilePath(dir.sumFile));
                 }
                 done += dir.totalSize;
-                if (fatal || canceled) {
+                if (fatal) {
                     break;
                 }
             }
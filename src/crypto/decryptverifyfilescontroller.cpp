@@ -34,6 +34,8 @@
 
 #include "decryptverifyfilescontroller.h"
 
+#include "fileoperationspreferences.h"
+
 #include <crypto/gui/decryptverifyoperationwidget.h>
 #include <crypto/gui/decryptverifyfileswizard.h>
 #include <crypto/decryptverifytask.h>
@@ -45,6 +47,7 @@
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
 #include <utils/archivedefinition.h>
+#include <utils/parallel.h>
 
 #include <Libkleo/Classify>
 
@@ -57,6 +60,7 @@
 #include <QPointer>
 #include <QTimer>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -93,8 +97,9 @@ public:
     QStringList m_passedFiles, m_filesAfterPreparation;
     QPointer<DecryptVerifyFilesWizard> m_wizard;
     std::vector<std::shared_ptr<const DecryptVerifyResult> > m_results;
-    std::vector<std::shared_ptr<Task> > m_runnableTasks, m_completedTasks;
-    std::shared_ptr<Task> m_runningTask;
+    std::vector<std::shared_ptr<Task> > m_runnableTasks, m_runningTasks, m_completedTasks;
+    std::weak_ptr<TaskCollection> m_taskCollection;
+    unsigned int m_maxRunningTasks;
     bool m_errorDetected;
     DecryptVerifyOperation m_operation;
 };
@@ -170,6 +175,10 @@ std::shared_ptr<AbstractDecryptVerifyTask> DecryptVerifyFilesController::Private
 DecryptVerifyFilesController::Private::Private(DecryptVerifyFilesController *qq) : q(qq), m_errorDetected(false), m_operation(DecryptVerify)
 {
     qRegisterMetaType<VerificationResult>();
+    m_maxRunningTasks = FileOperationsPreferences().maxConcurrentTasks();
+    if (!m_maxRunningTasks) {
+        m_maxRunningTasks = defaultParallelism();
+    }
 }
 
 void DecryptVerifyFilesController::Private::slotWizardOperationPrepared()
@@ -186,7 +195,11 @@ void DecryptVerifyFilesController::Private::slotWizardOperationPrepared()
     for (const auto &i: m_runnableTasks) {
         q->connectTask(i);
     }
+    coll->setEmitResultsInTaskOrder(true);
     coll->setTasks(m_runnableTasks);
+    // schedule() pops from the back, start with the first file
+    std::reverse(m_runnableTasks.begin(), m_runnableTasks.end());
+    m_taskCollection = coll;
     m_wizard->setTaskCollection(coll);
 
     QTimer::singleShot(0, q, SLOT(schedule()));
@@ -200,15 +213,19 @@ void DecryptVerifyFilesController::Private::slotWizardCanceled()
 void DecryptVerifyFilesController::doTaskDone(const Task *task, const std::shared_ptr<const Task::Result> &result)
 {
     Q_ASSERT(task);
-    Q_UNUSED(task);
 
     // We could just delete the tasks here, but we can't use
     // Qt::QueuedConnection here (we need sender()) and other slots
     // might not yet have executed. Therefore, we push completed tasks
     // into a burial container
 
-    d->m_completedTasks.push_back(d->m_runningTask);
-    d->m_runningTask.reset();
+    const std::vector<std::shared_ptr<Task> >::iterator it
+        = std::find_if(d->m_runningTasks.begin(), d->m_runningTasks.end(),
+                       [task](const std::shared_ptr<Task> &t) { return t.get() == task; });
+    if (it != d->m_runningTasks.end()) {
+        d->m_completedTasks.push_back(*it);
+        d->m_runningTasks.erase(it);
+    }
 
     if (const std::shared_ptr<const DecryptVerifyResult> &dvr = std::dynamic_pointer_cast<const DecryptVerifyResult>(result)) {
         d->m_results.push_back(dvr);
@@ -219,13 +236,13 @@ void DecryptVerifyFilesController::doTaskDone(const Task *task, const std::share
 
 void DecryptVerifyFilesController::Private::schedule()
 {
-    if (!m_runningTask && !m_runnableTasks.empty()) {
+    while (m_runningTasks.size() < m_maxRunningTasks && !m_runnableTasks.empty()) {
         const std::shared_ptr<Task> t = m_runnableTasks.back();
         m_runnableTasks.pop_back();
+        m_runningTasks.push_back(t);
         t->start();
-        m_runningTask = t;
     }
-    if (!m_runningTask) {
+    if (m_runningTasks.empty()) {
         kleo_assert(m_runnableTasks.empty());
         for (const auto &i: m_results) {
             Q_EMIT q->verificationResult(i->verificationResult());
@@ -442,12 +459,16 @@ void DecryptVerifyFilesController::Private::cancelAllTasks()
 {
 
     // we just kill all runnable tasks - this will not result in
-    // signal emissions.
+    // signal emissions, so the collection must not wait for them.
+    if (const std::shared_ptr<TaskCollection> coll = m_taskCollection.lock()) {
+        coll->abandonTasks(m_runnableTasks);
+    }
     m_runnableTasks.clear();
 
     // a cancel() will result in a call to
-    if (m_runningTask) {
-        m_runningTask->cancel();
+    const std::vector<std::shared_ptr<Task> > running = m_runningTasks;
+    for (const std::shared_ptr<Task> &t : running) {
+        t->cancel();
     }
 }
 
@@ -34,6 +34,8 @@
 
 #include "decryptverifytask.h"
 
+#include "signerkeycache.h"
+
 #include <QGpgME/Protocol>
 #include <QGpgME/VerifyOpaqueJob>
 #include <QGpgME/VerifyDetachedJob>
@@ -287,7 +289,7 @@ static QString formatSigningInformation(const Signature &sig)
     }
     const QDateTime dt = sig.creationTime() != 0 ? QDateTime::fromTime_t(sig.creationTime()) : QDateTime();
     QString text;
-    Key key = sig.key();
+    const Key key = SignerKeyCache::instance()->findSigner(sig);
     if (dt.isValid()) {
         text = i18nc("1 is a date", "Signature created on %1", formatDate(dt)) + QStringLiteral("<br>");
     }
@@ -353,17 +355,6 @@ static UserID findUserIDByMailbox(const Key &key, const Mailbox &mbox)
     return UserID();
 }
 
-static void updateKeys(const VerificationResult &result) {
-    // This little hack works around the problem that GnuPG / GpgME does not
-    // provide Key information in a verification result. The Key object is
-    // a dummy just holding the KeyID. This hack ensures that all available
-    // keys are fetched from the backend and are populated
-    for (const auto &sig: result.signatures()) {
-        // Update key information
-        sig.key(true, true);
-    }
-}
-
 }
 
 class DecryptVerifyResult::SenderInfo
@@ -447,10 +438,11 @@ static QString formatVerificationResultOverview(const VerificationResult &res, c
     //Good signature:
     QString text;
     if (sigs.size() == 1) {
-        text = i18n("<b>Valid signature by %1</b>", renderKeyEMailOnlyNameAsFallback(sigs[0].key()));
+        const Key key = SignerKeyCache::instance()->findSigner(sigs[0]);
+        text = i18n("<b>Valid signature by %1</b>", renderKeyEMailOnlyNameAsFallback(key));
         if (info.conflicts())
             text += i18n("<br/><b>Warning:</b> The sender's mail address is not stored in the %1 used for signing.",
-                         renderKeyLink(QLatin1String(sigs[0].key().primaryFingerprint()), i18n("certificate")));
+                         renderKeyLink(QLatin1String(key.primaryFingerprint()), i18n("certificate")));
     } else {
         text = i18np("<b>Valid signature.</b>", "<b>%1 valid signatures.</b>", sigs.size());
         if (info.conflicts()) {
@@ -482,7 +474,7 @@ static QString formatSignature(const Signature &sig, const DecryptVerifyResult::
     }
 
     const QString text = formatSigningInformation(sig) + QLatin1String("<br/>");
-    const Key key = sig.key();
+    const Key key = SignerKeyCache::instance()->findSigner(sig);
 
     // Green
     if (sig.summary() & Signature::Valid) {
@@ -685,7 +677,7 @@ public:
 
 DecryptVerifyResult::SenderInfo DecryptVerifyResult::Private::makeSenderInfo() const
 {
-    return SenderInfo(m_informativeSender, KeyCache::instance()->findSigners(m_verificationResult));
+    return SenderInfo(m_informativeSender, SignerKeyCache::instance()->findSigners(m_verificationResult));
 }
 
 std::shared_ptr<DecryptVerifyResult> AbstractDecryptVerifyTask::fromDecryptResult(const DecryptionResult &dr, const QByteArray &plaintext, const AuditLog &auditLog)
@@ -929,6 +921,7 @@ public:
     explicit Private(DecryptVerifyTask *qq) : q(qq), m_backend(nullptr), m_protocol(UnknownProtocol)  {}
 
     void slotResult(const DecryptionResult &, const VerificationResult &, const QByteArray &);
+    void processResult(const DecryptionResult &, const VerificationResult &, const QByteArray &, const AuditLog &);
 
     void registerJob(QGpgME::DecryptVerifyJob *job)
     {
@@ -954,13 +947,19 @@ void DecryptVerifyTask::Private::emitResult(const std::shared_ptr<DecryptVerifyR
 
 void DecryptVerifyTask::Private::slotResult(const DecryptionResult &dr, const VerificationResult &vr, const QByteArray &plainText)
 {
-    updateKeys(vr);
+    const AuditLog auditLog = auditLogFromSender(q->sender());
+    SignerKeyCache::instance()->resolve(vr, m_protocol, q, [this, dr, vr, plainText, auditLog]() {
+        processResult(dr, vr, plainText, auditLog);
+    });
+}
+
+void DecryptVerifyTask::Private::processResult(const DecryptionResult &dr, const VerificationResult &vr, const QByteArray &plainText, const AuditLog &auditLog)
+{
     {
         std::stringstream ss;
         ss << dr << '\n' << vr;
         qCDebug(KLEOPATRA_LOG) << ss.str().c_str();
     }
-    const AuditLog auditLog = auditLogFromSender(q->sender());
     if (dr.error().code() || vr.error().code()) {
         m_output->cancel();
     } else {
@@ -1250,6 +1249,7 @@ public:
     explicit Private(VerifyOpaqueTask *qq) : q(qq), m_backend(nullptr), m_protocol(UnknownProtocol)  {}
 
     void slotResult(const VerificationResult &, const QByteArray &);
+    void processResult(const VerificationResult &, const QByteArray &, const AuditLog &);
 
     void registerJob(QGpgME::VerifyOpaqueJob *job)
     {
@@ -1275,13 +1275,19 @@ void VerifyOpaqueTask::Private::emitResult(const std::shared_ptr<DecryptVerifyRe
 
 void VerifyOpaqueTask::Private::slotResult(const VerificationResult &result, const QByteArray &plainText)
 {
-    updateKeys(result);
+    const AuditLog auditLog = auditLogFromSender(q->sender());
+    SignerKeyCache::instance()->resolve(result, m_protocol, q, [this, result, plainText, auditLog]() {
+        processResult(result, plainText, auditLog);
+    });
+}
+
+void VerifyOpaqueTask::Private::processResult(const VerificationResult &result, const QByteArray &plainText, const AuditLog &auditLog)
+{
     {
         std::stringstream ss;
         ss << result;
         qCDebug(KLEOPATRA_LOG) << ss.str().c_str();
     }
-    const AuditLog auditLog = auditLogFromSender(q->sender());
     if (result.error().code()) {
         m_output->cancel();
     } else {
@@ -1406,6 +1412,7 @@ public:
     explicit Private(VerifyDetachedTask *qq) : q(qq), m_backend(nullptr), m_protocol(UnknownProtocol) {}
 
     void slotResult(const VerificationResult &);
+    void processResult(const VerificationResult &, const AuditLog &);
 
     void registerJob(QGpgME::VerifyDetachedJob *job)
     {
@@ -1430,13 +1437,19 @@ void VerifyDetachedTask::Private::emitResult(const std::shared_ptr<DecryptVerify
 
 void VerifyDetachedTask::Private::slotResult(const VerificationResult &result)
 {
-    updateKeys(result);
+    const AuditLog auditLog = auditLogFromSender(q->sender());
+    SignerKeyCache::instance()->resolve(result, m_protocol, q, [this, result, auditLog]() {
+        processResult(result, auditLog);
+    });
+}
+
+void VerifyDetachedTask::Private::processResult(const VerificationResult &result, const AuditLog &auditLog)
+{
     {
         std::stringstream ss;
         ss << result;
         qCDebug(KLEOPATRA_LOG) << ss.str().c_str();
     }
-    const AuditLog auditLog = auditLogFromSender(q->sender());
     try {
         kleo_assert(!result.isNull());
         emitResult(q->fromVerifyDetachedResult(result, auditLog));
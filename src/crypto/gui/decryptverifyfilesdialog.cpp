@@ -39,6 +39,7 @@
 #include "crypto/decryptverifytask.h"
 #include "crypto/gui/resultpage.h"
 #include "crypto/gui/resultlistwidget.h"
+#include "utils/gui-helper.h"
 
 #include <Libkleo/FileNameRequester>
 
@@ -133,6 +134,7 @@ void DecryptVerifyFilesDialog::allDone()
     Q_ASSERT(m_tasks);
     m_progressBar->setRange(0, 100);
     m_progressBar->setValue(100);
+    setProgressBarThroughput(m_progressBar, 0, -1);
     Q_FOREACH (const QString &i, m_progressLabelByTag.keys()) {
         if (!i.isEmpty()) {
             m_progressLabelByTag.value(i)->setText(i18n("%1: All operations completed.", i));
@@ -187,6 +189,7 @@ void DecryptVerifyFilesDialog::progress(const QString &msg, int progress, int to
     Q_ASSERT(total >= 0);
     m_progressBar->setRange(0, total);
     m_progressBar->setValue(progress);
+    setProgressBarThroughput(m_progressBar, m_tasks->throughput(), m_tasks->secondsRemaining());
 }
 
 void DecryptVerifyFilesDialog::setOutputLocation(const QString &dir)
@@ -39,6 +39,8 @@
 
 #include <crypto/taskcollection.h>
 
+#include <utils/gui-helper.h>
+
 #include <Libkleo/Stl_Util>
 
 #include <KLocalizedString>
@@ -103,6 +105,9 @@ void NewResultPage::Private::progress(const QString &msg, int progress, int tota
     Q_ASSERT(total >= 0);
     m_progressBar->setRange(0, total);
     m_progressBar->setValue(progress);
+    if (const TaskCollection *const coll = qobject_cast<TaskCollection *>(q->sender())) {
+        setProgressBarThroughput(m_progressBar, coll->throughput(), coll->secondsRemaining());
+    }
 }
 
 void NewResultPage::Private::allDone()
@@ -113,6 +118,7 @@ void NewResultPage::Private::allDone()
     }
     m_progressBar->setRange(0, 100);
     m_progressBar->setValue(100);
+    setProgressBarThroughput(m_progressBar, 0, -1);
     m_collections.clear();
     Q_FOREACH (const QString &i, m_progressLabelByTag.keys()) {
         if (!i.isEmpty()) {
@@ -0,0 +1,216 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/gui/resultitemdelegate.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "resultitemdelegate.h"
+
+#include "resultlistmodel.h"
+
+#include <KColorScheme>
+
+#include <QAbstractItemView>
+#include <QAbstractTextDocumentLayout>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QTextDocument>
+#include <QtMath>
+
+using namespace Kleo;
+using namespace Kleo::Crypto;
+using namespace Kleo::Crypto::Gui;
+
+namespace
+{
+static const int FrameMargin = 2;
+static const int TextPadding = 5;
+
+Task::Result::VisualCode visualCode(const QModelIndex &index)
+{
+    return static_cast<Task::Result::VisualCode>(index.data(ResultListModel::VisualCodeRole).toInt());
+}
+}
+
+QColor Kleo::Crypto::Gui::colorForVisualCode(Task::Result::VisualCode code)
+{
+    switch (code) {
+    case Task::Result::AllGood:
+        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::PositiveBackground).color();
+    case Task::Result::NeutralError:
+    case Task::Result::Warning:
+        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::NormalBackground).color();
+    case Task::Result::Danger:
+        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::NegativeBackground).color();
+    case Task::Result::NeutralSuccess:
+    default:
+        return QColor(0x00, 0x80, 0xFF); // light blue
+    }
+}
+
+QColor Kleo::Crypto::Gui::txtColorForVisualCode(Task::Result::VisualCode code)
+{
+    switch (code) {
+    case Task::Result::AllGood:
+        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::PositiveText).color();
+    case Task::Result::NeutralError:
+    case Task::Result::Warning:
+        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::NormalText).color();
+    case Task::Result::Danger:
+        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::NegativeText).color();
+    case Task::Result::NeutralSuccess:
+    default:
+        return QColor(0xFF, 0xFF, 0xFF); // white
+    }
+}
+
+ResultItemDelegate::ResultItemDelegate(QAbstractItemView *view)
+    : QStyledItemDelegate(view),
+      m_view(view),
+      m_sizeHints(),
+      m_sizeHintsWidth(-1)
+{
+    Q_ASSERT(m_view);
+    m_view->viewport()->setMouseTracking(true);
+    m_view->viewport()->installEventFilter(this);
+}
+
+ResultItemDelegate::~ResultItemDelegate()
+{
+}
+
+void ResultItemDelegate::invalidateSizeHints()
+{
+    m_sizeHints.clear();
+}
+
+void ResultItemDelegate::setupDocument(QTextDocument &doc, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    // Items span the whole viewport, whatever rect the view passes in
+    const int width = m_view->viewport()->width() - 2 * (FrameMargin + TextPadding);
+    doc.setDefaultFont(option.font);
+    doc.setDocumentMargin(0);
+    doc.setHtml(index.data(Qt::DisplayRole).toString());
+    doc.setTextWidth(qMax(width, 0));
+}
+
+QString ResultItemDelegate::anchorAt(const QPoint &pos, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QTextDocument doc;
+    setupDocument(doc, option, index);
+    const QPoint textPos = pos - option.rect.topLeft() - QPoint(FrameMargin + TextPadding, FrameMargin + TextPadding);
+    return doc.documentLayout()->anchorAt(textPos);
+}
+
+void ResultItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const Task::Result::VisualCode code = visualCode(index);
+    const QColor color = colorForVisualCode(code);
+    const QRect frame = option.rect.adjusted(FrameMargin, FrameMargin, -FrameMargin, -FrameMargin);
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen((option.state & QStyle::State_HasFocus) ? option.palette.color(QPalette::Highlight) : color.darker(150));
+    painter->setBrush(color);
+    painter->drawRoundedRect(QRectF(frame).adjusted(0.5, 0.5, -0.5, -0.5), 3, 3);
+
+    QTextDocument doc;
+    setupDocument(doc, option, index);
+    QAbstractTextDocumentLayout::PaintContext ctx;
+    ctx.palette = option.palette;
+    ctx.palette.setColor(QPalette::Text, txtColorForVisualCode(code));
+    ctx.clip = QRectF(0, 0, frame.width() - 2 * TextPadding, frame.height() - 2 * TextPadding);
+    painter->translate(frame.topLeft() + QPoint(TextPadding, TextPadding));
+    painter->setClipRect(ctx.clip);
+    doc.documentLayout()->draw(painter, ctx);
+    painter->restore();
+}
+
+QSize ResultItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const int width = m_view->viewport()->width();
+    if (width != m_sizeHintsWidth) {
+        m_sizeHints.clear();
+        m_sizeHintsWidth = width;
+    }
+
+    // Keyed by the row's text, so that expanding or collapsing a row
+    // is picked up without further bookkeeping
+    const QString text = index.data(Qt::DisplayRole).toString();
+    const auto it = m_sizeHints.constFind(text);
+    if (it != m_sizeHints.constEnd()) {
+        return *it;
+    }
+
+    QTextDocument doc;
+    setupDocument(doc, option, index);
+    const QSize size(width, qCeil(doc.size().height()) + 2 * (FrameMargin + TextPadding));
+    m_sizeHints.insert(text, size);
+    return size;
+}
+
+bool ResultItemDelegate::editorEvent(QEvent *event, QAbstractItemModel *model,
+                                     const QStyleOptionViewItem &option, const QModelIndex &index)
+{
+    if (event->type() == QEvent::MouseButtonRelease) {
+        const auto me = static_cast<QMouseEvent *>(event);
+        if (me->button() == Qt::LeftButton) {
+            const QString anchor = anchorAt(me->pos(), option, index);
+            if (!anchor.isEmpty()) {
+                Q_EMIT linkActivated(anchor, index);
+                return true;
+            }
+        }
+    }
+    return QStyledItemDelegate::editorEvent(event, model, option, index);
+}
+
+bool ResultItemDelegate::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_view->viewport() && event->type() == QEvent::MouseMove) {
+        const QPoint pos = static_cast<QMouseEvent *>(event)->pos();
+        const QModelIndex index = m_view->indexAt(pos);
+        QString anchor;
+        if (index.isValid()) {
+            QStyleOptionViewItem option;
+            option.initFrom(m_view);
+            option.font = m_view->font();
+            option.rect = m_view->visualRect(index);
+            anchor = anchorAt(pos, option, index);
+        }
+        if (anchor.isEmpty()) {
+            m_view->viewport()->unsetCursor();
+        } else {
+            m_view->viewport()->setCursor(Qt::PointingHandCursor);
+        }
+    }
+    return QStyledItemDelegate::eventFilter(watched, event);
+}
@@ -0,0 +1,91 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/gui/resultitemdelegate.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_CRYPTO_GUI_RESULTITEMDELEGATE_H__
+#define __KLEOPATRA_CRYPTO_GUI_RESULTITEMDELEGATE_H__
+
+#include <QStyledItemDelegate>
+
+#include <crypto/task.h>
+
+#include <QHash>
+
+class QAbstractItemView;
+class QTextDocument;
+
+namespace Kleo
+{
+namespace Crypto
+{
+namespace Gui
+{
+
+QColor colorForVisualCode(Task::Result::VisualCode code);
+QColor txtColorForVisualCode(Task::Result::VisualCode code);
+
+/* Paints the rich text of a ResultListModel row in a frame colored
+ * after the result's visual code. Only rows that are visible are laid
+ * out; links in a row are reported through linkActivated(). */
+class ResultItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    explicit ResultItemDelegate(QAbstractItemView *view);
+    ~ResultItemDelegate();
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    void invalidateSizeHints();
+
+Q_SIGNALS:
+    void linkActivated(const QString &link, const QModelIndex &index);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    bool editorEvent(QEvent *event, QAbstractItemModel *model,
+                     const QStyleOptionViewItem &option, const QModelIndex &index) override;
+
+private:
+    void setupDocument(QTextDocument &doc, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QString anchorAt(const QPoint &pos, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+    QAbstractItemView *const m_view;
+    mutable QHash<QString, QSize> m_sizeHints;
+    mutable int m_sizeHintsWidth;
+};
+
+}
+}
+}
+
+#endif // __KLEOPATRA_CRYPTO_GUI_RESULTITEMDELEGATE_H__
@@ -35,6 +35,7 @@
 #include <config-kleopatra.h>
 
 #include "resultitemwidget.h"
+#include "resultitemdelegate.h"
 
 #include "utils/auditlog.h"
 #include "commands/command.h"
@@ -56,48 +57,12 @@
 #include <QUrl>
 #include <QVBoxLayout>
 #include <KGuiItem>
-#include <KColorScheme>
 
 
 using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace Kleo::Crypto::Gui;
 
-namespace
-{
-// TODO move out of here
-static QColor colorForVisualCode(Task::Result::VisualCode code)
-{
-    switch (code) {
-    case Task::Result::AllGood:
-        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::PositiveBackground).color();
-    case Task::Result::NeutralError:
-    case Task::Result::Warning:
-        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::NormalBackground).color();
-    case Task::Result::Danger:
-        return KColorScheme(QPalette::Active, KColorScheme::View).background(KColorScheme::NegativeBackground).color();
-    case Task::Result::NeutralSuccess:
-    default:
-        return QColor(0x00, 0x80, 0xFF); // light blue
-    }
-}
-static QColor txtColorForVisualCode(Task::Result::VisualCode code)
-{
-    switch (code) {
-    case Task::Result::AllGood:
-        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::PositiveText).color();
-    case Task::Result::NeutralError:
-    case Task::Result::Warning:
-        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::NormalText).color();
-    case Task::Result::Danger:
-        return KColorScheme(QPalette::Active, KColorScheme::View).foreground(KColorScheme::NegativeText).color();
-    case Task::Result::NeutralSuccess:
-    default:
-        return QColor(0xFF, 0xFF, 0xFF); // white
-    }
-}
-}
-
 class ResultItemWidget::Private
 {
     ResultItemWidget *const q;
@@ -0,0 +1,211 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/gui/resultlistmodel.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "resultlistmodel.h"
+
+#include "crypto/decryptverifytask.h"
+#include "utils/auditlog.h"
+
+#include <gpgme++/verificationresult.h>
+
+#include <KLocalizedString>
+
+#include <QStringList>
+#include <QTextDocument>
+#include <QUrl>
+
+using namespace Kleo;
+using namespace Kleo::Crypto;
+using namespace Kleo::Crypto::Gui;
+
+namespace
+{
+QString actionLink(const QString &action, const QString &text)
+{
+    return QStringLiteral("<a href=\"kleoresultitem://%1\">%2</a>").arg(action, text.toHtmlEscaped());
+}
+
+QString keyImportLinks(const Task::Result &result)
+{
+    const auto dvResult = dynamic_cast<const DecryptVerifyResult *>(&result);
+    if (!dvResult) {
+        return QString();
+    }
+    const auto verifyResult = dvResult->verificationResult();
+    if (verifyResult.isNull()) {
+        return QString();
+    }
+
+    QStringList links;
+    for (const auto &sig : verifyResult.signatures()) {
+        if (!(sig.summary() & GpgME::Signature::KeyMissing)) {
+            continue;
+        }
+        const auto keyid = QLatin1String(sig.fingerprint());
+        QString suffix;
+        if (verifyResult.numSignatures() > 1) {
+            suffix = QLatin1Char(' ') + keyid;
+        }
+        links << actionLink(QStringLiteral("import/") + keyid,
+                            i18nc("1 is optional keyid. No space is intended as it can be empty.",
+                                  "Import%1", suffix))
+              // TODO: Only show if auto-key-retrieve is not set.
+              << actionLink(QStringLiteral("search/") + keyid,
+                            i18nc("1 is optional keyid. No space is intended as it can be empty.",
+                                  "Search%1", suffix));
+    }
+    return links.join(QStringLiteral(" &nbsp; "));
+}
+}
+
+ResultListModel::ResultListModel(QObject *parent)
+    : QAbstractListModel(parent),
+      m_items(),
+      m_numErrors(0)
+{
+}
+
+ResultListModel::~ResultListModel()
+{
+}
+
+void ResultListModel::addResult(const std::shared_ptr<const Task::Result> &result)
+{
+    Q_ASSERT(result);
+    const bool error = result->hasError();
+    const int row = error ? m_numErrors : static_cast<int>(m_items.size());
+    beginInsertRows(QModelIndex(), row, row);
+    m_items.insert(m_items.begin() + row, Item{result, false, QString()});
+    if (error) {
+        ++m_numErrors;
+    }
+    endInsertRows();
+}
+
+void ResultListModel::removeResult(const QModelIndex &index)
+{
+    if (!index.isValid() || index.model() != this) {
+        return;
+    }
+    const int row = index.row();
+    beginRemoveRows(QModelIndex(), row, row);
+    if (row < m_numErrors) {
+        --m_numErrors;
+    }
+    m_items.erase(m_items.begin() + row);
+    endRemoveRows();
+}
+
+std::shared_ptr<const Task::Result> ResultListModel::result(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return std::shared_ptr<const Task::Result>();
+    }
+    return m_items[index.row()].result;
+}
+
+bool ResultListModel::isExpanded(const QModelIndex &index) const
+{
+    return index.isValid() && index.row() < rowCount() && m_items[index.row()].expanded;
+}
+
+void ResultListModel::setExpanded(const QModelIndex &index, bool expanded)
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return;
+    }
+    Item &item = m_items[index.row()];
+    if (item.expanded == expanded) {
+        return;
+    }
+    item.expanded = expanded;
+    item.text.clear();
+    Q_EMIT dataChanged(index, index);
+}
+
+int ResultListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(m_items.size());
+}
+
+QVariant ResultListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const Item &item = m_items[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        if (item.text.isNull()) {
+            item.text = formatItem(item);
+        }
+        return item.text;
+    case Qt::ToolTipRole:
+        return item.result->hasError() ? item.result->errorString() : QVariant();
+    case VisualCodeRole:
+        return static_cast<int>(item.result->code());
+    case ExpandedRole:
+        return item.expanded;
+    case PlainTextRole: {
+        QTextDocument doc;
+        doc.setHtml(item.result->overview() + item.result->details());
+        return doc.toPlainText();
+    }
+    }
+    return QVariant();
+}
+
+QString ResultListModel::formatItem(const Item &item)
+{
+    const Task::Result &result = *item.result;
+
+    QStringList actions;
+    const QString importLinks = keyImportLinks(result);
+    if (!importLinks.isEmpty()) {
+        actions << importLinks;
+    }
+    const QString auditLogLink = result.auditLog().formatLink(QUrl(QStringLiteral("kleoresultitem://showauditlog")));
+    if (!auditLogLink.isEmpty()) {
+        actions << auditLogLink;
+    }
+    actions << actionLink(QStringLiteral("toggledetails"),
+                          item.expanded ? i18n("Hide Details") : i18n("Show Details"));
+
+    QString text = result.overview()
+                   + QLatin1String("<p>") + actions.join(QStringLiteral(" &nbsp; ")) + QLatin1String("</p>");
+    if (item.expanded) {
+        text += result.details();
+    }
+    return text;
+}
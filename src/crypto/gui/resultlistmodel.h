@@ -0,0 +1,93 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/gui/resultlistmodel.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_CRYPTO_GUI_RESULTLISTMODEL_H__
+#define __KLEOPATRA_CRYPTO_GUI_RESULTLISTMODEL_H__
+
+#include <QAbstractListModel>
+
+#include <crypto/task.h>
+
+#include <memory>
+#include <vector>
+
+namespace Kleo
+{
+namespace Crypto
+{
+namespace Gui
+{
+
+/* Holds the results of a result list, errors first. The rich text of a
+ * row is only formatted when a view asks for it, and the details of a
+ * result only once the row has been expanded. */
+class ResultListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role {
+        VisualCodeRole = Qt::UserRole + 1,
+        ExpandedRole,
+        PlainTextRole // overview and details, without the action links
+    };
+
+    explicit ResultListModel(QObject *parent = nullptr);
+    ~ResultListModel();
+
+    void addResult(const std::shared_ptr<const Task::Result> &result);
+    void removeResult(const QModelIndex &index);
+
+    std::shared_ptr<const Task::Result> result(const QModelIndex &index) const;
+
+    bool isExpanded(const QModelIndex &index) const;
+    void setExpanded(const QModelIndex &index, bool expanded);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Item {
+        std::shared_ptr<const Task::Result> result;
+        bool expanded;
+        mutable QString text;
+    };
+    static QString formatItem(const Item &item);
+
+    std::vector<Item> m_items;
+    int m_numErrors;
+};
+
+}
+}
+}
+
+#endif // __KLEOPATRA_CRYPTO_GUI_RESULTLISTMODEL_H__
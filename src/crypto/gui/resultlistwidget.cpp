@@ -36,26 +36,74 @@
 
 #include "emailoperationspreferences.h"
 
-#include <crypto/gui/resultitemwidget.h>
+#include <crypto/gui/resultitemdelegate.h>
+#include <crypto/gui/resultlistmodel.h>
 #include <crypto/taskcollection.h>
 
-#include <utils/scrollarea.h>
+#include <commands/command.h>
+#include <commands/importcertificatefromfilecommand.h>
+#include <commands/lookupcertificatescommand.h>
 
+#include <utils/auditlog.h>
+
+#include <Libkleo/Classify>
 #include <Libkleo/Stl_Util>
+#include <libkleo/messagebox.h>
 
 #include <KLocalizedString>
 #include <QPushButton>
 #include <KStandardGuiItem>
 
+#include <QAction>
+#include <QApplication>
+#include <QClipboard>
 #include <QLabel>
+#include <QListView>
+#include <QMenu>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QUrl>
 #include <QVBoxLayout>
 
 #include <KGuiItem>
 
+#include "kleopatra_debug.h"
+
+#include <utility>
+#include <vector>
+
 using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace Kleo::Crypto::Gui;
 
+namespace
+{
+// The links of a row's rich text, as (href, text) pairs in the order
+// they are shown
+std::vector<std::pair<QString, QString>> linksOf(const QModelIndex &index)
+{
+    std::vector<std::pair<QString, QString>> links;
+    QTextDocument doc;
+    doc.setHtml(index.data(Qt::DisplayRole).toString());
+    for (QTextBlock block = doc.begin(); block.isValid(); block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (!fragment.isValid() || !fragment.charFormat().isAnchor()) {
+                continue;
+            }
+            const QString href = fragment.charFormat().anchorHref();
+            // a link may be split into several fragments
+            if (!links.empty() && links.back().first == href) {
+                links.back().second += fragment.text();
+            } else {
+                links.push_back(std::make_pair(href, fragment.text()));
+            }
+        }
+    }
+    return links;
+}
+}
+
 class ResultListWidget::Private
 {
     ResultListWidget *const q;
@@ -66,15 +114,20 @@ public:
     void started(const std::shared_ptr<Task> &task);
     void allTasksDone();
 
-    void addResultWidget(ResultItemWidget *widget);
     void setupSingle();
     void setupMulti();
     void resizeIfStandalone();
 
+    void slotLinkActivated(const QString &link, const QModelIndex &index);
+    void showContextMenu(const QPoint &pos);
+    void copyToClipboard(const QModelIndex &index);
+    void startKeyImport(const QModelIndex &index, const QString &keyid, bool search);
+
     std::vector< std::shared_ptr<TaskCollection> > m_collections;
     bool m_standaloneMode;
-    int m_lastErrorItemIndex;
-    ScrollArea *m_scrollArea;
+    ResultListModel *m_model;
+    QListView *m_view;
+    ResultItemDelegate *m_delegate;
     QPushButton *m_closeButton;
     QVBoxLayout *m_layout;
     QLabel *m_progressLabel;
@@ -84,8 +137,9 @@ ResultListWidget::Private::Private(ResultListWidget *qq)
     : q(qq),
       m_collections(),
       m_standaloneMode(false),
-      m_lastErrorItemIndex(0),
-      m_scrollArea(nullptr),
+      m_model(nullptr),
+      m_view(nullptr),
+      m_delegate(nullptr),
       m_closeButton(nullptr),
       m_layout(nullptr),
       m_progressLabel(nullptr)
@@ -133,33 +187,42 @@ void ResultListWidget::Private::resizeIfStandalone()
 
 void ResultListWidget::Private::setupMulti()
 {
-    if (m_scrollArea) {
+    if (m_view) {
         return;    // already been here...
     }
 
-    m_scrollArea = new ScrollArea;
-    m_scrollArea->setFocusPolicy(Qt::NoFocus);
-    Q_ASSERT(qobject_cast<QBoxLayout *>(m_scrollArea->widget()->layout()));
-    static_cast<QBoxLayout *>(m_scrollArea->widget()->layout())->setMargin(0);
-    static_cast<QBoxLayout *>(m_scrollArea->widget()->layout())->setSpacing(2);
-    static_cast<QBoxLayout *>(m_scrollArea->widget()->layout())->addStretch();
-    m_layout->insertWidget(0, m_scrollArea);
-}
-
-void ResultListWidget::Private::addResultWidget(ResultItemWidget *widget)
-{
-    Q_ASSERT(widget);
-    Q_ASSERT(std::any_of(m_collections.cbegin(), m_collections.cend(),
-                       [](const std::shared_ptr<TaskCollection> &t) { return !t->isEmpty(); }));
-
-    Q_ASSERT(m_scrollArea);
-    Q_ASSERT(m_scrollArea->widget());
-    Q_ASSERT(qobject_cast<QBoxLayout *>(m_scrollArea->widget()->layout()));
-    QBoxLayout &blay = *static_cast<QBoxLayout *>(m_scrollArea->widget()->layout());
-    blay.insertWidget(widget->hasErrorResult() ? m_lastErrorItemIndex++ : (blay.count() - 1), widget);
-
-    widget->show();
-    resizeIfStandalone();
+    m_model = new ResultListModel(q);
+    m_view = new QListView;
+    m_view->setSelectionMode(QAbstractItemView::NoSelection);
+    m_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_view->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    m_view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    m_view->setResizeMode(QListView::Adjust);
+    // lay out (and measure) the rows in chunks instead of all at once
+    m_view->setLayoutMode(QListView::Batched);
+    m_view->setBatchSize(50);
+    m_view->setFrameShape(QFrame::NoFrame);
+    m_delegate = new ResultItemDelegate(m_view);
+    m_view->setItemDelegate(m_delegate);
+    m_view->setModel(m_model);
+    q->connect(m_delegate, &ResultItemDelegate::linkActivated,
+               q, [this](const QString &link, const QModelIndex &index) {
+        slotLinkActivated(link, index);
+    });
+    q->connect(m_view, &QAbstractItemView::activated, q, [this](const QModelIndex &index) {
+        m_model->setExpanded(index, !m_model->isExpanded(index));
+    });
+    // the links of a row are offered in its context menu, so that they
+    // can be reached with the keyboard, too (menu key, Shift+F10)
+    m_view->setContextMenuPolicy(Qt::CustomContextMenu);
+    q->connect(m_view, &QAbstractItemView::customContextMenuRequested,
+               q, [this](const QPoint &pos) { showContextMenu(pos); });
+    auto copyAction = new QAction(m_view);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setShortcutContext(Qt::WidgetShortcut);
+    q->connect(copyAction, &QAction::triggered, q, [this]() { copyToClipboard(m_view->currentIndex()); });
+    m_view->addAction(copyAction);
+    m_layout->insertWidget(0, m_view);
 }
 
 void ResultListWidget::Private::allTasksDone()
@@ -177,10 +240,121 @@ void ResultListWidget::Private::result(const std::shared_ptr<const Task::Result>
     Q_ASSERT(result);
     Q_ASSERT(std::any_of(m_collections.cbegin(), m_collections.cend(),
                        [](const std::shared_ptr<TaskCollection> &t) { return !t->isEmpty(); }));
-    ResultItemWidget *wid = new ResultItemWidget(result);
-    q->connect(wid, &ResultItemWidget::linkActivated, q, &ResultListWidget::linkActivated);
-    q->connect(wid, &ResultItemWidget::closeButtonClicked, q, &ResultListWidget::close);
-    addResultWidget(wid);
+    Q_ASSERT(m_model);
+    m_model->addResult(result);
+    resizeIfStandalone();
+}
+
+void ResultListWidget::Private::startKeyImport(const QModelIndex &index, const QString &keyid, bool search)
+{
+    const QPersistentModelIndex persistentIndex(index);
+    const auto canceled = std::make_shared<bool>(false);
+    const auto finished = [this, persistentIndex, canceled]() {
+        if (*canceled || !persistentIndex.isValid()) {
+            return;
+        }
+        // the restarted task reports a new result
+        const auto result = m_model->result(persistentIndex);
+        if (result && result->parentTask()) {
+            result->parentTask()->start();
+        }
+        m_model->removeResult(persistentIndex);
+    };
+
+    Command *cmd = nullptr;
+    if (search) {
+        cmd = new Kleo::Commands::LookupCertificatesCommand(keyid, nullptr);
+    } else {
+        cmd = new Kleo::ImportCertificateFromFileCommand();
+    }
+    q->connect(cmd, &Command::canceled, q, [canceled]() { *canceled = true; });
+    q->connect(cmd, &Command::finished, q, finished);
+    cmd->setParentWidget(q);
+    cmd->start();
+}
+
+void ResultListWidget::Private::slotLinkActivated(const QString &link, const QModelIndex &index)
+{
+    qCDebug(KLEOPATRA_LOG) << "Link activated: " << link;
+    if (link.startsWith(QLatin1String("key:"))) {
+        auto split = link.split(QLatin1Char(':'));
+        auto fpr = split.value(1);
+        if (split.size() == 2 && isFingerprint(fpr)) {
+            /* There might be a security consideration here if somehow
+             * a short keyid is used in a link and it collides with another.
+             * So we additionally check that it really is a fingerprint. */
+            auto cmd = Command::commandForQuery(fpr);
+            cmd->setParentWId(q->effectiveWinId());
+            cmd->start();
+        } else {
+            qCWarning(KLEOPATRA_LOG) << "key link invalid " << link;
+        }
+        return;
+    }
+
+    const QUrl url(link);
+    if (url.scheme() != QLatin1String("kleoresultitem")) {
+        Q_EMIT q->linkActivated(link);
+        return;
+    }
+
+    const auto result = m_model->result(index);
+    if (!result) {
+        return;
+    }
+    const QString action = url.host();
+    const QString keyid = url.path().mid(1);
+    if (action == QLatin1String("showauditlog")) {
+        MessageBox::auditLog(q, result->auditLog().text());
+    } else if (action == QLatin1String("toggledetails")) {
+        m_model->setExpanded(index, !m_model->isExpanded(index));
+    } else if (action == QLatin1String("import") && !keyid.isEmpty()) {
+        startKeyImport(index, keyid, false);
+    } else if (action == QLatin1String("search") && !keyid.isEmpty()) {
+        startKeyImport(index, keyid, true);
+    } else {
+        qCWarning(KLEOPATRA_LOG) << "Unexpected link scheme: " << link;
+    }
+}
+
+void ResultListWidget::Private::showContextMenu(const QPoint &pos)
+{
+    QModelIndex index = m_view->indexAt(pos);
+    if (!index.isValid()) {
+        index = m_view->currentIndex();
+    }
+    if (!index.isValid()) {
+        return;
+    }
+    m_view->setCurrentIndex(index);
+
+    const QPersistentModelIndex persistentIndex(index);
+    QMenu *menu = new QMenu(q);
+    for (const auto &link : linksOf(index)) {
+        const QString href = link.first;
+        menu->addAction(link.second, q, [this, href, persistentIndex]() {
+            if (persistentIndex.isValid()) {
+                slotLinkActivated(href, persistentIndex);
+            }
+        });
+    }
+    if (!menu->isEmpty()) {
+        menu->addSeparator();
+    }
+    QAction *const copyAction = menu->addAction(QIcon::fromTheme(QStringLiteral("edit-copy")),
+                                                i18n("Copy"),
+                                                q, [this, persistentIndex]() { copyToClipboard(persistentIndex); });
+    copyAction->setShortcut(QKeySequence::Copy);
+    q->connect(menu, &QMenu::aboutToHide, menu, &QObject::deleteLater);
+    menu->popup(m_view->viewport()->mapToGlobal(pos));
+}
+
+void ResultListWidget::Private::copyToClipboard(const QModelIndex &index)
+{
+    if (!index.isValid()) {
+        return;
+    }
+    QApplication::clipboard()->setText(index.data(ResultListModel::PlainTextRole).toString());
 }
 
 bool ResultListWidget::isComplete() const
@@ -51,6 +51,7 @@
 #include <QDialogButtonBox>
 #include <QPushButton>
 #include <QHeaderView>
+#include <QLocale>
 #include "kleopatra_debug.h"
 
 using namespace Kleo;
@@ -124,6 +125,13 @@ public Q_SLOTS:
         emitDataChangedFor(mi);
     }
 
+    void setStatuses(const QStringList &files, VerifyChecksumsDialog::Status status)
+    {
+        for (const QString &file : files) {
+            setStatus(file, status);
+        }
+    }
+
     void clearStatusInformation()
     {
         using std::swap;
@@ -351,6 +359,16 @@ private:
             progressBar.setValue(cur);
         }
 
+        void setThroughput(double mbps)
+        {
+            if (mbps > 0) {
+                progressBar.setFormat(i18nc("%p is the percentage, %1 the speed", "%p% (%1 MB/s)",
+                                            QLocale().toString(mbps, 'f', 1)));
+            } else {
+                progressBar.resetFormat();
+            }
+        }
+
         bool isProgressBarActive() const
         {
             const int tot = progressBar.maximum();
@@ -403,6 +421,18 @@ void VerifyChecksumsDialog::setStatus(const QString &file, Status status)
     d->model.setStatus(file, status);
 }
 
+// slot
+void VerifyChecksumsDialog::setStatuses(const QStringList &files, Status status)
+{
+    d->model.setStatuses(files, status);
+}
+
+// slot
+void VerifyChecksumsDialog::setThroughput(double mbps)
+{
+    d->ui.setThroughput(mbps);
+}
+
 // slot
 void VerifyChecksumsDialog::clearStatusInformation()
 {
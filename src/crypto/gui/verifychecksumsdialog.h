@@ -67,6 +67,8 @@ public Q_SLOTS:
     void setBaseDirectories(const QStringList &bases);
     void setProgress(int current, int total);
     void setStatus(const QString &file, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status status);
+    void setStatuses(const QStringList &files, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status status);
+    void setThroughput(double megabytesPerSecond);
     void setErrors(const QStringList &errors);
     void clearStatusInformation();
 
@@ -49,6 +49,7 @@
 #include "utils/kleo_assert.h"
 #include "utils/archivedefinition.h"
 #include "utils/path-helper.h"
+#include "utils/parallel.h"
 
 #include <Libkleo/Exception>
 #include <Libkleo/Classify>
@@ -63,6 +64,9 @@
 #include <QFileInfo>
 #include <QDir>
 
+#include <algorithm>
+#include <numeric>
+
 using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace GpgME;
@@ -93,13 +97,16 @@ private:
 
     void schedule();
     std::shared_ptr<SignEncryptTask> takeRunnable(GpgME::Protocol proto);
+    void scheduleProtocol(GpgME::Protocol proto, std::vector< std::shared_ptr<SignEncryptTask> > &running);
 
     static void assertValidOperation(unsigned int);
     static QString titleForOperation(unsigned int op);
 private:
     std::vector< std::shared_ptr<SignEncryptTask> > runnable, completed;
-    std::shared_ptr<SignEncryptTask> cms, openpgp;
+    std::vector< std::shared_ptr<SignEncryptTask> > cms, openpgp;
+    unsigned int maxRunningPerProtocol;
     QPointer<SignEncryptFilesWizard> wizard;
+    std::weak_ptr<TaskCollection> taskCollection;
     QStringList files;
     unsigned int operation;
     Protocol protocol;
@@ -110,12 +117,16 @@ SignEncryptFilesController::Private::Private(SignEncryptFilesController *qq)
       runnable(),
       cms(),
       openpgp(),
+      maxRunningPerProtocol(FileOperationsPreferences().maxConcurrentTasks()),
       wizard(),
+      taskCollection(),
       files(),
       operation(SignAllowed | EncryptAllowed | ArchiveAllowed),
       protocol(UnknownProtocol)
 {
-
+    if (!maxRunningPerProtocol) {
+        maxRunningPerProtocol = defaultParallelism();
+    }
 }
 
 SignEncryptFilesController::Private::~Private()
@@ -399,8 +410,7 @@ createSignEncryptTaskForFileInfo(const QFileInfo &fi, bool ascii,
 }
 
 static std::shared_ptr<SignEncryptTask>
-createArchiveSignEncryptTaskForFiles(const QStringList &files,
-                                     const std::shared_ptr<ArchiveDefinition> &ad, bool pgp, bool ascii,
+createArchiveSignEncryptTaskForFiles(const QStringList &files, bool ascii,
                                      const std::vector<Key> &recipients, const std::vector<Key> &signers,
                                      const QString& outputName, bool symmetric)
 {
@@ -422,13 +432,7 @@ createArchiveSignEncryptTaskForFiles(const QStringList &files,
         task->setEncrypt(false);
     }
 
-    kleo_assert(ad);
-
-    const Protocol proto = pgp ? OpenPGP : CMS;
-
     task->setInputFileNames(files);
-    task->setInput(ad->createInputFromPackCommand(proto, files));
-
     task->setOutputFileName(outputName);
 
     return task;
@@ -492,6 +496,7 @@ createArchiveSignEncryptTasksForFiles(const QStringList &files, const std::share
     const bool cms = !cmsSigners.empty() || !cmsRecipients.empty();
 
     result.reserve(pgp + cms);
+    std::vector<Protocol> protocols;
 
     if (pgp || symmetric) {
         int outKind = 0;
@@ -502,21 +507,32 @@ createArchiveSignEncryptTasksForFiles(const QStringList &files, const std::share
         } else {
             outKind = SignEncryptFilesWizard::SignaturePGP;
         }
-        result.push_back(createArchiveSignEncryptTaskForFiles(files, ad, true,  ascii, pgpRecipients, pgpSigners, outputNames[outKind], symmetric));
+        result.push_back(createArchiveSignEncryptTaskForFiles(files, ascii, pgpRecipients, pgpSigners, outputNames[outKind], symmetric));
+        protocols.push_back(OpenPGP);
     }
     if (cms) {
         if (!cmsSigners.empty()) {
-            result.push_back(createArchiveSignEncryptTaskForFiles(files, ad, false, ascii,
+            result.push_back(createArchiveSignEncryptTaskForFiles(files, ascii,
                                                                   std::vector<Key>(), cmsSigners, outputNames[SignEncryptFilesWizard::SignatureCMS],
                                                                   false));
+            protocols.push_back(CMS);
         }
         if (!cmsRecipients.empty()) {
-            result.push_back(createArchiveSignEncryptTaskForFiles(files, ad, false, ascii,
+            result.push_back(createArchiveSignEncryptTaskForFiles(files, ascii,
                                                                   cmsRecipients, std::vector<Key>(), outputNames[SignEncryptFilesWizard::EncryptedCMS],
                                                                   false));
+            protocols.push_back(CMS);
         }
     }
 
+    // Pack the files only once; the tasks share the output of the pack
+    // command and must therefore all run at the same time.
+    kleo_assert(ad);
+    const std::vector< std::shared_ptr<Input> > inputs = ad->createInputsFromPackCommand(protocols, files);
+    for (unsigned int i = 0; i < result.size(); ++i) {
+        result[i]->setInput(inputs[i]);
+    }
+
     return result;
 }
 
@@ -554,8 +570,10 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
         }
 
         std::vector< std::shared_ptr<SignEncryptTask> > tasks;
+        std::vector<qint64> inputSizes;
         if (!archive) {
             tasks.reserve(files.size());
+            inputSizes.reserve(files.size());
         }
 
         if (archive) {
@@ -568,11 +586,13 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
                     cmsSigners.toStdVector(),
                     wizard->outputNames(),
                     wizard->encryptSymmetric());
-
+            // see createArchiveSignEncryptTasksForFiles()
+            maxRunningPerProtocol = std::max<unsigned int>(maxRunningPerProtocol, tasks.size());
         } else {
             Q_FOREACH (const QString &file, files) {
+                const QFileInfo fi(file);
                 const std::vector< std::shared_ptr<SignEncryptTask> > created =
-                    createSignEncryptTasksForFileInfo(QFileInfo(file), ascii,
+                    createSignEncryptTasksForFileInfo(fi, ascii,
                             pgpRecipients.toStdVector(),
                             pgpSigners.toStdVector(),
                             cmsRecipients.toStdVector(),
@@ -580,6 +600,7 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
                             buildOutputNamesForDir(file, wizard->outputNames()),
                             wizard->encryptSymmetric());
                 tasks.insert(tasks.end(), created.begin(), created.end());
+                inputSizes.insert(inputSizes.end(), created.size(), fi.size());
             }
         }
 
@@ -590,7 +611,19 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
 
         kleo_assert(runnable.empty());
 
-        runnable.swap(tasks);
+        // Start the biggest inputs first, so that a large file does not
+        // end up running alone at the end. The collection still reports
+        // the results in the order of the input files.
+        std::vector<size_t> order(tasks.size());
+        std::iota(order.begin(), order.end(), 0);
+        if (inputSizes.size() == tasks.size()) {
+            std::stable_sort(order.begin(), order.end(),
+                             [&inputSizes](size_t lhs, size_t rhs) { return inputSizes[lhs] > inputSizes[rhs]; });
+        }
+        runnable.reserve(tasks.size());
+        for (size_t i : order) {
+            runnable.push_back(tasks[i]);
+        }
 
         Q_FOREACH (const std::shared_ptr<Task> &task, runnable) {
             q->connectTask(task);
@@ -599,9 +632,11 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
         std::shared_ptr<TaskCollection> coll(new TaskCollection);
 
         std::vector<std::shared_ptr<Task> > tmp;
-        std::copy(runnable.begin(), runnable.end(), std::back_inserter(tmp));
+        std::copy(tasks.begin(), tasks.end(), std::back_inserter(tmp));
+        coll->setEmitResultsInTaskOrder(true);
         coll->setTasks(tmp);
         wizard->setTaskCollection(coll);
+        taskCollection = coll;
 
         QTimer::singleShot(0, q, SLOT(schedule()));
 
@@ -619,25 +654,27 @@ void SignEncryptFilesController::Private::slotWizardOperationPrepared()
 
 void SignEncryptFilesController::Private::schedule()
 {
+    scheduleProtocol(CMS, cms);
+    scheduleProtocol(OpenPGP, openpgp);
 
-    if (!cms)
-        if (const std::shared_ptr<SignEncryptTask> t = takeRunnable(CMS)) {
-            t->start();
-            cms = t;
-        }
-
-    if (!openpgp)
-        if (const std::shared_ptr<SignEncryptTask> t = takeRunnable(OpenPGP)) {
-            t->start();
-            openpgp = t;
-        }
-
-    if (!cms && !openpgp) {
+    if (cms.empty() && openpgp.empty()) {
         kleo_assert(runnable.empty());
         q->emitDoneOrError();
     }
 }
 
+void SignEncryptFilesController::Private::scheduleProtocol(GpgME::Protocol proto, std::vector< std::shared_ptr<SignEncryptTask> > &running)
+{
+    while (running.size() < maxRunningPerProtocol) {
+        const std::shared_ptr<SignEncryptTask> t = takeRunnable(proto);
+        if (!t) {
+            return;
+        }
+        running.push_back(t);
+        t->start();
+    }
+}
+
 std::shared_ptr<SignEncryptTask> SignEncryptFilesController::Private::takeRunnable(GpgME::Protocol proto)
 {
     const auto it = std::find_if(runnable.begin(), runnable.end(),
@@ -661,12 +698,14 @@ void SignEncryptFilesController::doTaskDone(const Task *task, const std::shared_
     // might not yet have executed. Therefore, we push completed tasks
     // into a burial container
 
-    if (task == d->cms.get()) {
-        d->completed.push_back(d->cms);
-        d->cms.reset();
-    } else if (task == d->openpgp.get()) {
-        d->completed.push_back(d->openpgp);
-        d->openpgp.reset();
+    for (std::vector< std::shared_ptr<SignEncryptTask> > *running : { &d->cms, &d->openpgp }) {
+        const auto it = std::find_if(running->begin(), running->end(),
+                                     [task](const std::shared_ptr<SignEncryptTask> &t) { return t.get() == task; });
+        if (it != running->end()) {
+            d->completed.push_back(*it);
+            running->erase(it);
+            break;
+        }
     }
 
     QTimer::singleShot(0, this, SLOT(schedule()));
@@ -689,15 +728,17 @@ void SignEncryptFilesController::Private::cancelAllTasks()
 {
 
     // we just kill all runnable tasks - this will not result in
-    // signal emissions.
+    // signal emissions, so the collection must not wait for them.
+    if (const std::shared_ptr<TaskCollection> coll = taskCollection.lock()) {
+        coll->abandonTasks(std::vector<std::shared_ptr<Task> >(runnable.begin(), runnable.end()));
+    }
     runnable.clear();
 
     // a cancel() will result in a call to
-    if (cms) {
-        cms->cancel();
-    }
-    if (openpgp) {
-        openpgp->cancel();
+    std::vector< std::shared_ptr<SignEncryptTask> > running = cms;
+    std::copy(openpgp.begin(), openpgp.end(), std::back_inserter(running));
+    for (const std::shared_ptr<SignEncryptTask> &t : running) {
+        t->cancel();
     }
 }
 
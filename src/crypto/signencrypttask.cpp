@@ -482,7 +482,13 @@ void SignEncryptTask::doStart()
     kleo_assert(d->input);
 
     if (!d->output) {
-        d->output = Output::createFromFile(d->outputFileName, d->m_overwritePolicy);
+        try {
+            d->output = Output::createFromFile(d->outputFileName, d->m_overwritePolicy);
+        } catch (...) {
+            // don't keep other readers of a shared archive input waiting for us
+            d->input->finalize();
+            throw;
+        }
     }
 
     if (d->encrypt || d->symmetric) {
@@ -576,7 +582,9 @@ void SignEncryptTask::Private::slotResult(const SigningResult &result)
     bool outputCreated = false;
     if (result.error().code()) {
         output->cancel();
+        input->finalize();
     } else if (input->failed()) {
+        input->finalize();
         q->emitResult(makeErrorResult(Error::fromCode(GPG_ERR_EIO),
                                       i18n("Input error: %1", escape( input->errorString())),
                                       auditLog));
@@ -603,8 +611,10 @@ void SignEncryptTask::Private::slotResult(const SigningResult &sresult, const En
     bool outputCreated = false;
     if (sresult.error().code() || eresult.error().code()) {
         output->cancel();
+        input->finalize();
     } else if (input->failed()) {
         output->cancel();
+        input->finalize();
         q->emitResult(makeErrorResult(Error::fromCode(GPG_ERR_EIO),
                                       i18n("Input error: %1", escape( input->errorString())),
                                       auditLog));
@@ -631,8 +641,10 @@ void SignEncryptTask::Private::slotResult(const EncryptionResult &result)
     bool outputCreated = false;
     if (result.error().code()) {
         output->cancel();
+        input->finalize();
     } else if (input->failed()) {
         output->cancel();
+        input->finalize();
         q->emitResult(makeErrorResult(Error::fromCode(GPG_ERR_EIO),
                                       i18n("Input error: %1", escape(input->errorString())),
                                       auditLog));
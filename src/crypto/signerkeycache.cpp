@@ -0,0 +1,356 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/signerkeycache.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "signerkeycache.h"
+
+#include <QGpgME/KeyListJob>
+#include <QGpgME/Protocol>
+
+#include <Libkleo/KeyCache>
+
+#include <gpgme++/key.h>
+#include <gpgme++/keylistresult.h>
+#include <gpgme++/verificationresult.h>
+
+#include "kleopatra_debug.h"
+
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+#include <algorithm>
+#include <map>
+
+using namespace Kleo;
+using namespace Kleo::Crypto;
+using namespace GpgME;
+
+namespace
+{
+QByteArray signerId(const Signature &sig)
+{
+    return QByteArray(sig.fingerprint()).toUpper();
+}
+
+// gpgsm gets all patterns of a listing in one Assuan line, which must
+// not exceed 1000 bytes (including "LISTKEYS "), so CMS listings are
+// limited to about 20 fingerprints. gpg takes them on the command line.
+static const int maxCmsPatternBytes = 900;
+}
+
+class SignerKeyCache::Private
+{
+    friend class ::Kleo::Crypto::SignerKeyCache;
+    SignerKeyCache *const q;
+public:
+    explicit Private(SignerKeyCache *qq);
+
+    void startListings();
+    void slotNextKey(const Key &key);
+    void slotListingResult(const KeyListResult &result);
+    void keysMayHaveChanged();
+
+private:
+    // A null key marks an ID that was looked up without success
+    struct Entry {
+        Key key;
+        unsigned int generation;
+    };
+    struct Waiter {
+        QSet<QByteArray> ids;
+        QPointer<QObject> context;
+        std::function<void()> done;
+    };
+    struct Listing {
+        Listing() : job(nullptr) {}
+        QGpgME::KeyListJob *job;
+        QSet<QByteArray> running;
+        QSet<QByteArray> queued;
+    };
+
+    bool isCurrent(const QByteArray &id) const;
+    bool isPending(const QByteArray &id) const;
+    void scheduleListings();
+    void finishListing(Listing &listing, bool listed);
+    void notifyWaiters();
+
+    QHash<QByteArray, Entry> m_entries;
+    unsigned int m_generation;
+    std::map<Protocol, Listing> m_listings;
+    std::vector<Waiter> m_waiters;
+    bool m_listingsScheduled;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+SignerKeyCache::Private::Private(SignerKeyCache *qq)
+    : q(qq),
+      m_entries(),
+      m_generation(0),
+      m_listings(),
+      m_waiters(),
+      m_listingsScheduled(false),
+      m_hits(0),
+      m_misses(0)
+{
+    // Keep the keys for formatting results that were already resolved,
+    // but look them up again for new results
+    q->connect(KeyCache::instance().get(), SIGNAL(keysMayHaveChanged()),
+               q, SLOT(keysMayHaveChanged()));
+}
+
+bool SignerKeyCache::Private::isCurrent(const QByteArray &id) const
+{
+    const auto it = m_entries.constFind(id);
+    return it != m_entries.constEnd() && it->generation == m_generation;
+}
+
+bool SignerKeyCache::Private::isPending(const QByteArray &id) const
+{
+    for (const auto &it : m_listings) {
+        if (it.second.running.contains(id) || it.second.queued.contains(id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SignerKeyCache::Private::keysMayHaveChanged()
+{
+    ++m_generation;
+}
+
+void SignerKeyCache::Private::scheduleListings()
+{
+    // let the results of all tasks that finish together join one listing
+    if (!m_listingsScheduled) {
+        m_listingsScheduled = true;
+        QTimer::singleShot(0, q, SLOT(startListings()));
+    }
+}
+
+void SignerKeyCache::Private::startListings()
+{
+    m_listingsScheduled = false;
+    for (auto &it : m_listings) {
+        Listing &listing = it.second;
+        if (listing.job || listing.queued.isEmpty()) {
+            continue;
+        }
+        if (it.first == CMS) {
+            // the rest is listed once this listing is done
+            int bytes = 0;
+            for (auto id = listing.queued.begin(); id != listing.queued.end();) {
+                bytes += id->size() + 1;
+                if (bytes > maxCmsPatternBytes && !listing.running.isEmpty()) {
+                    break;
+                }
+                listing.running.insert(*id);
+                id = listing.queued.erase(id);
+            }
+        } else {
+            listing.running = listing.queued;
+            listing.queued.clear();
+        }
+
+        const QGpgME::Protocol *const backend = it.first == CMS ? QGpgME::smime() : QGpgME::openpgp();
+        QGpgME::KeyListJob *const job = backend ? backend->keyListJob(/*remote*/false, /*includeSigs*/false, /*validate*/true) : nullptr;
+        if (!job) {
+            // the remaining chunks would not fare better
+            finishListing(listing, false);
+            listing.queued.clear();
+            continue;
+        }
+
+        /* Old style connect here again as QGPGME newstyle connects with
+         * default arguments don't work on windows. */
+        q->connect(job, SIGNAL(nextKey(GpgME::Key)),
+                   q, SLOT(slotNextKey(GpgME::Key)));
+        q->connect(job, SIGNAL(result(GpgME::KeyListResult)),
+                   q, SLOT(slotListingResult(GpgME::KeyListResult)));
+
+        QStringList patterns;
+        patterns.reserve(listing.running.size());
+        for (const QByteArray &id : qAsConst(listing.running)) {
+            patterns.push_back(QString::fromLatin1(id));
+        }
+        if (const Error err = job->start(patterns)) {
+            qCDebug(KLEOPATRA_LOG) << "Listing of signer keys failed to start:" << err.asString();
+            job->deleteLater();
+            finishListing(listing, false);
+            listing.queued.clear();
+            continue;
+        }
+        listing.job = job;
+        qCDebug(KLEOPATRA_LOG) << "Looking up" << patterns.size() << "signer keys;"
+                               << m_hits << "signatures resolved from cache," << m_misses << "not";
+    }
+    notifyWaiters();
+}
+
+void SignerKeyCache::Private::slotNextKey(const Key &key)
+{
+    const Entry entry = { key, m_generation };
+    for (const Subkey &subkey : key.subkeys()) {
+        if (subkey.fingerprint()) {
+            m_entries.insert(QByteArray(subkey.fingerprint()).toUpper(), entry);
+        }
+        if (subkey.keyID()) {
+            m_entries.insert(QByteArray(subkey.keyID()).toUpper(), entry);
+        }
+    }
+}
+
+void SignerKeyCache::Private::slotListingResult(const KeyListResult &result)
+{
+    for (auto &it : m_listings) {
+        Listing &listing = it.second;
+        if (listing.job != q->sender()) {
+            continue;
+        }
+        listing.job = nullptr;
+        if (result.error() && !result.error().isCanceled()) {
+            qCDebug(KLEOPATRA_LOG) << "Listing of signer keys failed:" << result.error().asString();
+        }
+        finishListing(listing, !result.error());
+        if (!listing.queued.isEmpty()) {
+            scheduleListings();
+        }
+        break;
+    }
+    notifyWaiters();
+}
+
+void SignerKeyCache::Private::finishListing(Listing &listing, bool listed)
+{
+    // After a failed listing, the IDs are tried again with the next result
+    if (listed) {
+        for (const QByteArray &id : qAsConst(listing.running)) {
+            if (!isCurrent(id)) {
+                m_entries.insert(id, Entry{ Key(), m_generation });
+            }
+        }
+    }
+    listing.running.clear();
+}
+
+void SignerKeyCache::Private::notifyWaiters()
+{
+    std::vector<Waiter> ready;
+    for (auto it = m_waiters.begin(); it != m_waiters.end();) {
+        if (std::any_of(it->ids.cbegin(), it->ids.cend(),
+                        [this](const QByteArray &id) { return isPending(id); })) {
+            ++it;
+        } else {
+            ready.push_back(std::move(*it));
+            it = m_waiters.erase(it);
+        }
+    }
+    // done() may well ask for more signers
+    for (const Waiter &waiter : ready) {
+        if (waiter.context) {
+            waiter.done();
+        }
+    }
+}
+
+std::shared_ptr<SignerKeyCache> SignerKeyCache::instance()
+{
+    static const std::shared_ptr<SignerKeyCache> self(new SignerKeyCache);
+    return self;
+}
+
+SignerKeyCache::SignerKeyCache()
+    : QObject(), d(new Private(this))
+{
+}
+
+SignerKeyCache::~SignerKeyCache()
+{
+}
+
+void SignerKeyCache::resolve(const VerificationResult &result, Protocol protocol,
+                             QObject *context, const std::function<void()> &done)
+{
+    Q_ASSERT(done);
+    if (protocol != CMS) {
+        protocol = OpenPGP;
+    }
+
+    QSet<QByteArray> ids;
+    for (const Signature &sig : result.signatures()) {
+        const QByteArray id = signerId(sig);
+        if (id.isEmpty()) {
+            continue;
+        }
+        if (d->isCurrent(id)) {
+            ++d->m_hits;
+            continue;
+        }
+        ++d->m_misses;
+        ids.insert(id);
+        if (!d->isPending(id)) {
+            d->m_listings[protocol].queued.insert(id);
+        }
+    }
+
+    if (ids.isEmpty()) {
+        done();
+        return;
+    }
+    d->m_waiters.push_back({ ids, QPointer<QObject>(context), done });
+    d->scheduleListings();
+}
+
+Key SignerKeyCache::findSigner(const Signature &sig) const
+{
+    const Key key = d->m_entries.value(signerId(sig)).key;
+    return key.isNull() ? sig.key() : key;
+}
+
+std::vector<Key> SignerKeyCache::findSigners(const VerificationResult &result) const
+{
+    std::vector<Key> signers;
+    for (const Signature &sig : result.signatures()) {
+        const Key key = findSigner(sig);
+        if (!key.isNull()) {
+            signers.push_back(key);
+        }
+    }
+    return signers;
+}
+
+#include "moc_signerkeycache.cpp"
@@ -0,0 +1,92 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/signerkeycache.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_CRYPTO_SIGNERKEYCACHE_H__
+#define __KLEOPATRA_CRYPTO_SIGNERKEYCACHE_H__
+
+#include <QObject>
+
+#include <utils/pimpl_ptr.h>
+
+#include <gpgme++/global.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace GpgME
+{
+class Key;
+class KeyListResult;
+class Signature;
+class VerificationResult;
+}
+
+namespace Kleo
+{
+namespace Crypto
+{
+
+/* Resolves the signer keys of verification results. Keys are cached by
+ * fingerprint and key ID for all tasks; the keys that are not known yet
+ * are looked up together in one asynchronous key listing per protocol. */
+class SignerKeyCache : public QObject
+{
+    Q_OBJECT
+public:
+    static std::shared_ptr<SignerKeyCache> instance();
+    ~SignerKeyCache();
+
+    /* Calls done once the signers of result have been looked up; right
+     * away if they are known already. done is dropped if context is
+     * destroyed before. */
+    void resolve(const GpgME::VerificationResult &result, GpgME::Protocol protocol,
+                 QObject *context, const std::function<void()> &done);
+
+    GpgME::Key findSigner(const GpgME::Signature &sig) const;
+    std::vector<GpgME::Key> findSigners(const GpgME::VerificationResult &result) const;
+
+private:
+    SignerKeyCache();
+
+    class Private;
+    kdtools::pimpl_ptr<Private> d;
+    Q_PRIVATE_SLOT(d, void startListings())
+    Q_PRIVATE_SLOT(d, void slotNextKey(GpgME::Key))
+    Q_PRIVATE_SLOT(d, void slotListingResult(GpgME::KeyListResult))
+    Q_PRIVATE_SLOT(d, void keysMayHaveChanged())
+};
+
+}
+}
+
+#endif // __KLEOPATRA_CRYPTO_SIGNERKEYCACHE_H__
@@ -199,6 +199,10 @@ void Task::emitError(int errCode, const QString &details)
 
 void Task::emitResult(const std::shared_ptr<const Task::Result> &r)
 {
+    // the audit logs of failures and warnings are the ones people read
+    if (r && (r->hasError() || r->code() == Result::Warning || r->code() == Result::Danger)) {
+        r->auditLog().keepWhile(r);
+    }
     d->m_progress = d->m_totalProgress;
     Q_EMIT progress(progressLabel(), currentProgress(), totalProgress(), QPrivateSignal());
     Q_EMIT result(r, QPrivateSignal());
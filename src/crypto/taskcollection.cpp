@@ -40,11 +40,20 @@
 
 #include "utils/gnupg-helper.h"
 
+#include <QElapsedTimer>
+#include <QTimer>
+
 #include <algorithm>
 #include <map>
+#include <set>
 
 #include <cmath>
 
+// progress is passed on at most this often, however often the tasks report it
+static const int PROGRESS_EMISSION_INTERVAL = 100; // ms
+// weight of the latest measurement in the smoothed throughput
+static const double THROUGHPUT_SMOOTHING = 0.3;
+
 using namespace Kleo;
 using namespace Kleo::Crypto;
 
@@ -57,9 +66,35 @@ public:
     void taskProgress(const QString &, int, int);
     void taskResult(const std::shared_ptr<const Task::Result> &);
     void taskStarted();
-    void calculateAndEmitProgress();
+    void updateTaskProgress(const Task *task);
+    void scheduleProgress();
+    void emitProgress();
+    void updateThroughput();
+    void emitResultInOrder(int taskId, const std::shared_ptr<const Task::Result> &);
+    void emitHeldBackResults();
+
+    struct TaskProgress {
+        quint64 current = 0;
+        quint64 total = 0;
+    };
 
     std::map<int, std::shared_ptr<Task> > m_tasks;
+    // last progress seen per task, and the sums over all of them
+    std::map<int, TaskProgress> m_taskProgress;
+    quint64 m_sumCurrent;
+    quint64 m_sumTotal;
+    unsigned int m_numUnknownTotals;
+    QTimer m_progressTimer;
+    QElapsedTimer m_lastEmission;
+    QElapsedTimer m_throughputTimer;
+    quint64 m_throughputBase;
+    double m_throughput;
+    std::vector<int> m_order; // task ids, in setTasks() order
+    std::map<int, size_t> m_positions; // task id -> index into m_order
+    std::map<int, std::shared_ptr<const Task::Result> > m_heldBackResults;
+    std::set<int> m_abandoned; // ids of tasks that will not report a result
+    size_t m_nextResultPosition;
+    bool m_resultsInOrder;
     mutable quint64 m_totalProgress;
     mutable quint64 m_progress;
     unsigned int m_nCompleted;
@@ -68,8 +103,23 @@ public:
     bool m_doneEmitted;
 };
 
-TaskCollection::Private::Private(TaskCollection *qq) : q(qq), m_totalProgress(0), m_progress(0), m_nCompleted(0), m_errorOccurred(false), m_doneEmitted(false)
+TaskCollection::Private::Private(TaskCollection *qq)
+    : q(qq),
+      m_sumCurrent(0),
+      m_sumTotal(0),
+      m_numUnknownTotals(0),
+      m_throughputBase(0),
+      m_throughput(0),
+      m_nextResultPosition(0),
+      m_resultsInOrder(false),
+      m_totalProgress(0),
+      m_progress(0),
+      m_nCompleted(0),
+      m_errorOccurred(false),
+      m_doneEmitted(false)
 {
+    m_progressTimer.setSingleShot(true);
+    QObject::connect(&m_progressTimer, &QTimer::timeout, q, [this]() { emitProgress(); });
 }
 
 int TaskCollection::numberOfCompletedTasks() const
@@ -91,7 +141,8 @@ bool TaskCollection::allTasksCompleted() const
 void TaskCollection::Private::taskProgress(const QString &msg, int, int)
 {
     m_lastProgressMessage = msg;
-    calculateAndEmitProgress();
+    updateTaskProgress(qobject_cast<Task *>(q->sender()));
+    scheduleProgress();
 }
 
 void TaskCollection::Private::taskResult(const std::shared_ptr<const Task::Result> &result)
@@ -100,21 +151,61 @@ void TaskCollection::Private::taskResult(const std::shared_ptr<const Task::Resul
     ++m_nCompleted;
     m_errorOccurred = m_errorOccurred || result->hasError();
     m_lastProgressMessage.clear();
-    calculateAndEmitProgress();
-    Q_EMIT q->result(result);
+    const Task *const task = qobject_cast<Task *>(q->sender());
+    updateTaskProgress(task);
+    // completion is always shown right away
+    emitProgress();
+    if (m_resultsInOrder && task) {
+        emitResultInOrder(task->id(), result);
+    } else {
+        Q_EMIT q->result(result);
+    }
     if (!m_doneEmitted && q->allTasksCompleted()) {
         Q_EMIT q->done();
         m_doneEmitted = true;
     }
 }
 
+void TaskCollection::Private::emitResultInOrder(int taskId, const std::shared_ptr<const Task::Result> &result)
+{
+    const std::map<int, size_t>::const_iterator pos = m_positions.find(taskId);
+    if (pos == m_positions.end() || pos->second < m_nextResultPosition) {
+        // unknown, or restarted after its result was already passed on
+        Q_EMIT q->result(result);
+        return;
+    }
+    m_heldBackResults[taskId] = result;
+    emitHeldBackResults();
+}
+
+void TaskCollection::Private::emitHeldBackResults()
+{
+    while (m_nextResultPosition < m_order.size()) {
+        const int taskId = m_order[m_nextResultPosition];
+        const std::map<int, std::shared_ptr<const Task::Result> >::iterator it
+            = m_heldBackResults.find(taskId);
+        if (it == m_heldBackResults.end()) {
+            if (m_abandoned.count(taskId)) {
+                ++m_nextResultPosition;
+                continue;
+            }
+            break;
+        }
+        const std::shared_ptr<const Task::Result> r = it->second;
+        m_heldBackResults.erase(it);
+        ++m_nextResultPosition;
+        Q_EMIT q->result(r);
+    }
+}
+
 void TaskCollection::Private::taskStarted()
 {
     const Task *const task = qobject_cast<Task *>(q->sender());
     Q_ASSERT(task);
     Q_ASSERT(m_tasks.find(task->id()) != m_tasks.end());
     Q_EMIT q->started(m_tasks[task->id()]);
-    calculateAndEmitProgress(); // start Knight-Rider-Mode right away (gpgsm doesn't report _any_ progress).
+    updateTaskProgress(task);
+    scheduleProgress(); // start Knight-Rider-Mode right away (gpgsm doesn't report _any_ progress).
     if (m_doneEmitted) {
         // We are not done anymore, one task restarted.
         m_nCompleted--;
@@ -122,12 +213,65 @@ void TaskCollection::Private::taskStarted()
     }
 }
 
-void TaskCollection::Private::calculateAndEmitProgress()
+void TaskCollection::Private::updateTaskProgress(const Task *task)
 {
-    typedef std::map<int, std::shared_ptr<Task> >::const_iterator ConstIterator;
+    if (!task) {
+        return;
+    }
+    const std::map<int, TaskProgress>::iterator it = m_taskProgress.find(task->id());
+    if (it == m_taskProgress.end()) {
+        return;
+    }
+    TaskProgress &tp = it->second;
+    if (!tp.total) {
+        --m_numUnknownTotals;
+    }
+    m_sumCurrent -= tp.current;
+    m_sumTotal -= tp.total;
+    tp.current = std::max(0, task->currentProgress());
+    tp.total = std::max(0, task->totalProgress());
+    m_sumCurrent += tp.current;
+    m_sumTotal += tp.total;
+    if (!tp.total) {
+        ++m_numUnknownTotals;
+    }
+}
+
+void TaskCollection::Private::scheduleProgress()
+{
+    if (m_progressTimer.isActive()) {
+        return;
+    }
+    if (!m_lastEmission.isValid() || m_lastEmission.elapsed() >= PROGRESS_EMISSION_INTERVAL) {
+        emitProgress();
+    } else {
+        m_progressTimer.start(PROGRESS_EMISSION_INTERVAL - m_lastEmission.elapsed());
+    }
+}
+
+void TaskCollection::Private::updateThroughput()
+{
+    if (!m_throughputTimer.isValid() || m_sumCurrent < m_throughputBase) {
+        // first measurement, or a task restarted
+        m_throughputTimer.start();
+        m_throughputBase = m_sumCurrent;
+        m_throughput = 0;
+        return;
+    }
+    const qint64 elapsed = m_throughputTimer.elapsed();
+    if (elapsed < PROGRESS_EMISSION_INTERVAL) {
+        return;
+    }
+    const double current = (m_sumCurrent - m_throughputBase) * 1000.0 / elapsed;
+    m_throughput = m_throughput > 0 ? THROUGHPUT_SMOOTHING * current + (1 - THROUGHPUT_SMOOTHING) * m_throughput : current;
+    m_throughputTimer.start();
+    m_throughputBase = m_sumCurrent;
+}
 
-    quint64 total = 0;
-    quint64 processed = 0;
+void TaskCollection::Private::emitProgress()
+{
+    m_progressTimer.stop();
+    m_lastEmission.start();
 
     static bool haveWorkingProgress = engineIsVersion(2, 1, 15);
     if (!haveWorkingProgress) {
@@ -143,30 +287,18 @@ void TaskCollection::Private::calculateAndEmitProgress()
         return;
     }
 
-    bool unknowable = false;
-    for (ConstIterator it = m_tasks.begin(), end = m_tasks.end(); it != end; ++it) {
-        // Sum up progress and totals
-        const std::shared_ptr<Task> &i = it->second;
-        Q_ASSERT(i);
-        if (!i->totalProgress()) {
-            // There still might be jobs for which we don't know the progress.
-            qCDebug(KLEOPATRA_LOG) << "Task: " << i->label() << " has no total progress set. ";
-            unknowable = true;
-            break;
-        }
-        processed += i->currentProgress();
-        total += i->totalProgress();
-    }
+    // There still might be jobs for which we don't know the progress.
+    const bool unknowable = m_numUnknownTotals > 0;
 
-    m_totalProgress = total;
-    m_progress = processed;
-    if (!unknowable && processed && total >= processed) {
+    m_totalProgress = m_sumTotal;
+    m_progress = m_sumCurrent;
+    updateThroughput();
+    if (!unknowable && m_progress && m_totalProgress >= m_progress) {
         // Scale down to avoid range issues.
         int scaled = 1000 * (m_progress / static_cast<double>(m_totalProgress));
-        qCDebug(KLEOPATRA_LOG) << "Collection Progress: " << scaled << " total: " << 1000;
         Q_EMIT q->progress(m_lastProgressMessage, scaled, 1000);
     } else {
-        if (total < processed) {
+        if (m_totalProgress < m_progress) {
             qCDebug(KLEOPATRA_LOG) << "Total progress is smaller then current progress.";
         }
         // Knight rider.
@@ -192,6 +324,19 @@ bool TaskCollection::errorOccurred() const
     return d->m_errorOccurred;
 }
 
+double TaskCollection::throughput() const
+{
+    return d->m_throughput;
+}
+
+int TaskCollection::secondsRemaining() const
+{
+    if (d->m_numUnknownTotals || d->m_throughput <= 0 || d->m_totalProgress < d->m_progress) {
+        return -1;
+    }
+    return std::ceil((d->m_totalProgress - d->m_progress) / d->m_throughput);
+}
+
 std::shared_ptr<Task> TaskCollection::taskById(int id) const
 {
     const std::map<int, std::shared_ptr<Task> >::const_iterator it = d->m_tasks.find(id);
@@ -214,6 +359,13 @@ void TaskCollection::setTasks(const std::vector<std::shared_ptr<Task> > &tasks)
     for (const std::shared_ptr<Task> &i : tasks) {
         Q_ASSERT(i);
         d->m_tasks[i->id()] = i;
+        if (d->m_taskProgress.insert(std::make_pair(i->id(), Private::TaskProgress())).second) {
+            ++d->m_numUnknownTotals;
+        }
+        d->updateTaskProgress(i.get());
+        if (d->m_positions.insert(std::make_pair(i->id(), d->m_order.size())).second) {
+            d->m_order.push_back(i->id());
+        }
         connect(i.get(), SIGNAL(progress(QString,int,int)),
                 this, SLOT(taskProgress(QString,int,int)));
         connect(i.get(), SIGNAL(result(std::shared_ptr<const Kleo::Crypto::Task::Result>)),
@@ -223,4 +375,24 @@ void TaskCollection::setTasks(const std::vector<std::shared_ptr<Task> > &tasks)
     }
 }
 
+void TaskCollection::abandonTasks(const std::vector<std::shared_ptr<Task> > &tasks)
+{
+    for (const std::shared_ptr<Task> &i : tasks) {
+        if (i) {
+            d->m_abandoned.insert(i->id());
+        }
+    }
+    d->emitHeldBackResults();
+}
+
+void TaskCollection::setEmitResultsInTaskOrder(bool inOrder)
+{
+    d->m_resultsInOrder = inOrder;
+}
+
+bool TaskCollection::emitResultsInTaskOrder() const
+{
+    return d->m_resultsInOrder;
+}
+
 #include "moc_taskcollection.cpp"
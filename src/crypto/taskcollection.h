@@ -60,6 +60,16 @@ public:
 
     void setTasks(const std::vector<std::shared_ptr<Task> > &tasks);
 
+    // If set, result() is emitted in the order the tasks were passed to
+    // setTasks(), holding back results of tasks that finish early. Use
+    // this when several tasks of the collection run concurrently.
+    void setEmitResultsInTaskOrder(bool inOrder);
+    bool emitResultsInTaskOrder() const;
+
+    // Tells the collection that tasks will never be started (e.g. after
+    // a cancel), so that results held back for them are passed on.
+    void abandonTasks(const std::vector<std::shared_ptr<Task> > &tasks);
+
     bool isEmpty() const;
     size_t size() const;
 
@@ -67,6 +77,12 @@ public:
     bool allTasksCompleted() const;
     bool errorOccurred() const;
 
+    // Aggregate progress per second over the running tasks, smoothed;
+    // bytes for tasks that report their progress in bytes.
+    double throughput() const;
+    // Estimated time until all tasks are done, or -1 if unknown.
+    int secondsRemaining() const;
+
 Q_SIGNALS:
     void progress(const QString &msg, int processed, int total);
     void result(const std::shared_ptr<const Kleo::Crypto::Task::Result> &result);
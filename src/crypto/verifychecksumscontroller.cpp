@@ -38,9 +38,12 @@
 
 #include <crypto/gui/verifychecksumsdialog.h>
 
+#include <utils/checksumengine.h>
+#include <utils/checksumscanner.h>
 #include <utils/input.h>
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
+#include <utils/parallel.h>
 
 #include <Libkleo/Stl_Util>
 #include <Libkleo/ChecksumDefinition>
@@ -55,12 +58,14 @@
 #include <QMutex>
 #include <QProgressDialog>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QProcess>
 
 #include <gpg-error.h>
 
-#include <deque>
+#include <atomic>
 #include <limits>
+#include <map>
 #include <set>
 
 using namespace Kleo;
@@ -104,39 +109,6 @@ static QStringList fs_intersect(QStringList l1, QStringList l2)
 }
 #endif
 
-static QList<QRegExp> get_patterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    QList<QRegExp> result;
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                result.push_back(QRegExp(pattern, fs_cs));
-            }
-    return result;
-}
-
-namespace
-{
-struct matches_any : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_any(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::any_of(m_regexps.cbegin(), m_regexps.cend(),
-                           [&s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-struct matches_none_of : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_none_of(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::none_of(m_regexps.cbegin(), m_regexps.cend(),
-                            [&s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-}
-
 class VerifyChecksumsController::Private : public QThread
 {
     Q_OBJECT
@@ -150,6 +122,8 @@ Q_SIGNALS:
     void baseDirectories(const QStringList &);
     void progress(int, int, const QString &);
     void status(const QString &file, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status);
+    void statuses(const QStringList &files, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status);
+    void throughput(double megabytesPerSecond);
 
 private:
     void slotOperationFinished()
@@ -240,6 +214,10 @@ void VerifyChecksumsController::start()
                 d->dialog.data(), &VerifyChecksumsDialog::setProgress);
         connect(d.get(), &Private::status,
                 d->dialog.data(), &VerifyChecksumsDialog::setStatus);
+        connect(d.get(), &Private::statuses,
+                d->dialog.data(), &VerifyChecksumsDialog::setStatuses);
+        connect(d.get(), &Private::throughput,
+                d->dialog.data(), &VerifyChecksumsDialog::setThroughput);
 
         d->canceled = false;
         d->errors.clear();
@@ -260,30 +238,18 @@ void VerifyChecksumsController::cancel()
 
 namespace
 {
+struct File {
+    QString name;
+    QByteArray checksum;
+    bool binary;
+};
 
 struct SumFile {
     QDir dir;
     QString sumFile;
     quint64 totalSize;
     std::shared_ptr<ChecksumDefinition> checksumDefinition;
-};
-
-}
-
-static QStringList filter_checksum_files(QStringList l, const QList<QRegExp> &rxs)
-{
-    l.erase(std::remove_if(l.begin(), l.end(),
-                           matches_none_of(rxs)),
-            l.end());
-    return l;
-}
-
-namespace
-{
-struct File {
-    QString name;
-    QByteArray checksum;
-    bool binary;
+    std::vector<File> files;
 };
 }
 
@@ -336,27 +302,6 @@ static std::vector<File> parse_sum_file(const QString &fileName)
     return files;
 }
 
-static quint64 aggregate_size(const QDir &dir, const QStringList &files)
-{
-    quint64 n = 0;
-    for (const QString &file : files) {
-        n += QFileInfo(dir.absoluteFilePath(file)).size();
-    }
-    return n;
-}
-
-static std::shared_ptr<ChecksumDefinition> filename2definition(const QString &fileName,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns())
-                if (QRegExp(pattern, fs_cs).exactMatch(fileName)) {
-                    return cd;
-                }
-    return std::shared_ptr<ChecksumDefinition>();
-}
-
 namespace
 {
 struct less_dir : std::binary_function<QDir, QDir, bool> {
@@ -446,45 +391,63 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
         const std::function<void(int)> &progress,
         const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
 {
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
-
-    const matches_any is_sum_file(patterns);
+    const ChecksumFilePatterns patterns(checksumDefinitions);
 
     std::map<QDir, std::set<QString, less_file>, less_dir> dirs2sums;
 
     // Step 1: find the sumfiles we need to check:
 
-    std::deque<QString> inputs(files.begin(), files.end());
+    QStringList inputDirs, otherFiles;
+    for (const QString &file : files) {
+        if (QFileInfo(file).isDir()) {
+            inputDirs.push_back(file);
+        } else {
+            otherFiles.push_back(file);
+        }
+    }
 
     int i = 0;
-    while (!inputs.empty()) {
-        const QString file = inputs.front();
+
+    // Step 1a: all sumfiles in the given directories and below:
+
+    const std::vector<DirectoryListing> listings = scanDirectories(inputDirs, true, progress);
+    i += listings.size();
+    std::map<QString, const DirectoryListing *> listingsByPath;
+    for (const DirectoryListing &listing : listings) {
+        const QStringList sumfiles = patterns.sumFiles(listing.files);
+        qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files: found " << sumfiles.size()
+                               << " sum files in " << qPrintable(listing.path) << ": "
+                               << qPrintable(sumfiles.join(QStringLiteral(", ")));
+        dirs2sums[ QDir(listing.path) ].insert(sumfiles.begin(), sumfiles.end());
+        listingsByPath[listing.path] = &listing;
+    }
+
+    // Step 1b: the sumfiles given or covering the given files:
+
+    QStringList parentDirs;
+    for (const QString &file : otherFiles) {
+        const QString parent = QFileInfo(file).absolutePath();
+        if (!patterns.matches(QFileInfo(file).fileName()) && !listingsByPath.count(parent) && !parentDirs.contains(parent)) {
+            parentDirs.push_back(parent);
+        }
+    }
+    const std::vector<DirectoryListing> parentListings = scanDirectories(parentDirs, false);
+    for (const DirectoryListing &listing : parentListings) {
+        listingsByPath[listing.path] = &listing;
+    }
+
+    for (const QString &file : otherFiles) {
         qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files: considering " << qPrintable(file);
-        inputs.pop_front();
         const QFileInfo fi(file);
         const QString fileName = fi.fileName();
-        if (fi.isDir()) {
-            qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's a directory";
-            QDir dir(file);
-            const QStringList sumfiles = filter_checksum_files(dir.entryList(QDir::Files), patterns);
-            qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << sumfiles.size()
-                                   << " sum files: " << qPrintable(sumfiles.join(QStringLiteral(", ")));
-            dirs2sums[ dir ].insert(sumfiles.begin(), sumfiles.end());
-            const QStringList dirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-            qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << dirs.size()
-                                   << " subdirs, prepending";
-            std::transform(dirs.cbegin(), dirs.cend(),
-                           std::inserter(inputs, inputs.begin()),
-                           [&dir](const QString &path) {
-                               return dir.absoluteFilePath(path);
-                           });
-        } else if (is_sum_file(fileName)) {
+        if (patterns.matches(fileName)) {
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's a sum file";
             dirs2sums[fi.dir()].insert(fileName);
         } else {
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's something else; checking whether we'll find a sumfile for it...";
             const QDir dir = fi.dir();
-            const QStringList sumfiles = filter_checksum_files(dir.entryList(QDir::Files), patterns);
+            const auto listing = listingsByPath.find(fi.absolutePath());
+            const QStringList sumfiles = listing == listingsByPath.end() ? QStringList() : patterns.sumFiles(listing->second->files);
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << sumfiles.size()
                                    << " potential sumfiles: " << qPrintable(sumfiles.join(QStringLiteral(", ")));
             const auto it = std::find_if(sumfiles.cbegin(), sumfiles.cend(),
@@ -500,7 +463,19 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
         }
     }
 
-    // Step 2: convert into vector<SumFile>:
+    // Step 2: convert into vector<SumFile>, getting the file sizes
+    // from the listings where we have them:
+
+    QStringList unlistedDirs;
+    for (const auto &entry : dirs2sums) {
+        if (!entry.second.empty() && !listingsByPath.count(entry.first.absolutePath())) {
+            unlistedDirs.push_back(entry.first.absolutePath());
+        }
+    }
+    const std::vector<DirectoryListing> sumFileListings = scanDirectories(unlistedDirs, false);
+    for (const DirectoryListing &listing : sumFileListings) {
+        listingsByPath[listing.path] = &listing;
+    }
 
     std::vector<SumFile> sumfiles;
     sumfiles.reserve(dirs2sums.size());
@@ -512,6 +487,7 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
         }
 
         const QDir &dir = it->first;
+        const DirectoryListing &listing = *listingsByPath.at(dir.absolutePath());
 
         Q_FOREACH (const QString &sumFileName, it->second) {
 
@@ -523,8 +499,9 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
             const SumFile sumFile = {
                 it->first,
                 sumFileName,
-                aggregate_size(it->first, files),
-                filename2definition(sumFileName, checksumDefinitions),
+                listing.totalSize(files),
+                patterns.definition(sumFileName),
+                summedfiles,
             };
             sumfiles.push_back(sumFile);
 
@@ -614,6 +591,63 @@ static QString process(const SumFile &sumFile, bool *fatal, const QStringList &e
     return QString();
 }
 
+namespace
+{
+// Collects per-file results from the hashing workers and hands them to
+// the dialog in batches, grouped by status, instead of one queued signal
+// per file.
+class StatusBatcher
+{
+public:
+    explicit StatusBatcher(const std::function<void(const QStringList &, VerifyChecksumsDialog::Status)> &flush)
+        : m_flush(flush)
+    {
+        m_timer.start();
+    }
+
+    void add(const QString &file, VerifyChecksumsDialog::Status status)
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_pending[status].push_back(file);
+        if (++m_numPending >= MaxBatchSize || m_timer.elapsed() >= MaxBatchDelay) {
+            flushLocked();
+        }
+    }
+
+    void flush()
+    {
+        const QMutexLocker locker(&m_mutex);
+        flushLocked();
+    }
+
+private:
+    void flushLocked()
+    {
+        for (int i = 0; i < VerifyChecksumsDialog::NumStatii; ++i)
+            if (!m_pending[i].empty()) {
+                m_flush(m_pending[i], static_cast<VerifyChecksumsDialog::Status>(i));
+                m_pending[i].clear();
+            }
+        m_numPending = 0;
+        m_timer.restart();
+    }
+
+private:
+    enum { MaxBatchSize = 256, MaxBatchDelay = 100 /*ms*/ };
+    const std::function<void(const QStringList &, VerifyChecksumsDialog::Status)> m_flush;
+    QMutex m_mutex;
+    QElapsedTimer m_timer;
+    QStringList m_pending[VerifyChecksumsDialog::NumStatii];
+    int m_numPending = 0;
+};
+}
+
+static double megabytes_per_second(quint64 bytes, const QElapsedTimer &timer)
+{
+    const qint64 ms = timer.elapsed();
+    return ms > 0 ? bytes / 1000.0 / ms : 0.0;
+}
+
 namespace
 {
 static QDebug operator<<(QDebug s, const SumFile &sum)
@@ -675,8 +709,97 @@ void VerifyChecksumsController::Private::run()
             // re-scale 'total' to fit into ints (wish QProgressDialog would use quint64...)
             const quint64 factor = total / std::numeric_limits<int>::max() + 1;
 
-            quint64 done = 0;
+            QElapsedTimer timer;
+            timer.start();
+
+            // Step 2a: verify everything we can do ourselves on all cores:
+
+            std::map<std::shared_ptr<ChecksumDefinition>, ChecksumEngine> engines;
+            for (const SumFile &sumFile : sumfiles) {
+                engines.emplace(sumFile.checksumDefinition, ChecksumEngine(sumFile.checksumDefinition));
+            }
+
+            struct HashJob {
+                size_t sumFile;            // index into sumfiles
+                QString path;              // absolute, precomputed here, since QDir isn't safe to share across threads
+                QByteArray expected;       // lower-case hex
+            };
+            std::vector<HashJob> jobs;
+            std::vector<QString> labels(sumfiles.size());
+            for (size_t i = 0, end = sumfiles.size(); i != end; ++i) {
+                const SumFile &sumFile = sumfiles[i];
+                if (!engines.at(sumFile.checksumDefinition).canVerify()) {
+                    continue;
+                }
+                labels[i] = i18n("Verifying checksums (%2) in %1", sumFile.checksumDefinition->label(), sumFile.dir.path());
+                for (const File &file : sumFile.files) {
+                    const HashJob job = { i, sumFile.dir.absoluteFilePath(file.name), file.checksum.toLower() };
+                    jobs.push_back(job);
+                }
+            }
+
+            StatusBatcher batcher([this](const QStringList &files, VerifyChecksumsDialog::Status st) {
+                Q_EMIT statuses(files, st);
+            });
+            std::vector<int> mismatches(sumfiles.size(), 0);
+            QStringList readErrors;
+            QMutex resultsMutex;
+
+            std::atomic<quint64> hashed(0);
+            std::atomic<int> lastPermille(-1);
+            parallelFor(static_cast<int>(jobs.size()), [&](int idx) {
+                if (canceled) {
+                    return;
+                }
+                const HashJob &job = jobs[idx];
+                const ChecksumEngine &engine = engines.at(sumfiles[job.sumFile].checksumDefinition);
+                QString error;
+                const QByteArray checksum = engine.checksum(job.path, &error, [&](quint64 n) {
+                    // only emit when the per-mille value changes, so a pool
+                    // full of workers doesn't flood the GUI thread:
+                    const quint64 done = hashed += n;
+                    const int permille = total ? static_cast<int>(done * 1000 / total) : 1000;
+                    int last = lastPermille;
+                    if (permille > last && lastPermille.compare_exchange_strong(last, permille)) {
+                        Q_EMIT progress(done / factor, total / factor, labels[job.sumFile]);
+                        Q_EMIT throughput(megabytes_per_second(done, timer));
+                    }
+                }, &canceled);
+                if (canceled) {
+                    return;
+                }
+                if (checksum.isNull()) {
+                    batcher.add(job.path, VerifyChecksumsDialog::Error);
+                    const QMutexLocker resultsLocker(&resultsMutex);
+                    readErrors.push_back(error);
+                } else if (checksum == job.expected) {
+                    batcher.add(job.path, VerifyChecksumsDialog::OK);
+                } else {
+                    batcher.add(job.path, VerifyChecksumsDialog::Failed);
+                    const QMutexLocker resultsLocker(&resultsMutex);
+                    ++mismatches[job.sumFile];
+                }
+            });
+            batcher.flush();
+
+            errors += readErrors;
+            for (size_t i = 0, end = sumfiles.size(); i != end; ++i)
+                if (mismatches[i])
+                    errors.push_back(i18np("%2: one computed checksum did not match",
+                                           "%2: %1 computed checksums did not match",
+                                           mismatches[i], sumfiles[i].dir.absoluteFilePath(sumfiles[i].sumFile)));
+
+            // Step 2b: run the external command for all definitions we
+            // don't implement ourselves:
+
+            quint64 done = hashed;
             Q_FOREACH (const SumFile &sumFile, sumfiles) {
+                if (canceled) {
+                    break;
+                }
+                if (engines.at(sumFile.checksumDefinition).canVerify()) {
+                    continue;
+                }
                 Q_EMIT progress(done / factor, total / factor,
                                 i18n("Verifying checksums (%2) in %1", sumFile.checksumDefinition->label(), sumFile.dir.path()));
                 bool fatal = false;
@@ -685,7 +808,8 @@ void VerifyChecksumsController::Private::run()
                     errors.push_back(error);
                 }
                 done += sumFile.totalSize;
-                if (fatal || canceled) {
+                Q_EMIT throughput(megabytes_per_second(done, timer));
+                if (fatal) {
                     break;
                 }
             }
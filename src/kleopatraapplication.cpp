@@ -77,6 +77,7 @@
 #include <QPointer>
 
 #include <memory>
+#include <KConfigGroup>
 #include <KSharedConfig>
 
 using namespace Kleo;
@@ -122,6 +123,12 @@ public:
                 sysTray, &SysTrayIcon::setAnyCardHasNullPin);
         connect(&readerStatus, &SmartCard::ReaderStatus::anyCardCanLearnKeysChanged,
                 sysTray, &SysTrayIcon::setAnyCardCanLearnKeys);
+#endif
+#ifdef HAVE_USABLE_ASSUAN
+        const KConfigGroup uiServerConfig(KSharedConfig::openConfig(), "UiServer");
+        if (const unsigned int size = uiServerConfig.readEntry("PipeBufferSize", 0U)) {
+            KDPipeIODevice::setBufferSize(size);
+        }
 #endif
     }
 
@@ -31,7 +31,12 @@
 #include <QScrollBar>
 
 #include <algorithm>
+#include <bitset>
+#include <deque>
 #include <iterator>
+#include <vector>
+
+#include <climits>
 
 /*!
   \class KDLogTextWidget
@@ -44,7 +49,12 @@
 
   You can set initial text using setLines(), and append lines with
   calls to message(). You can limit the number of lines kept in the
-  view using setHistorySize().
+  view using setHistorySize(). Lines are kept in a ring buffer, so
+  dropping old lines is as cheap as appending new ones.
+
+  Use findLine() to search the text, and setCurrentLine() to show and
+  highlight a match. Lines are indexed as they are appended, so a
+  search skips most non-matching lines without looking at their text.
 
   Text formatting is currently limited to per-line text color, but is
   expected to be enhanced on client request in upcoming versions. You
@@ -110,11 +120,40 @@ public:
 
     unsigned int findOrAddStyle(const Style &style);
 
+    void appendLine(const LineItem &li);
+    void indexLine(quint64 seq, const QString &text);
+    void dropIndexedLines();
+    const LineItem &line(int idx) const
+    {
+        Q_ASSERT(idx >= 0 && idx < numLines);
+        return lines[(firstLine + idx) % lines.size()];
+    }
+
 private:
     QHash<unsigned int, Style> styleByID;
     QHash<Style, unsigned int> idByStyle;
 
-    QVector<LineItem> lines, pendingLines;
+    // ring buffer: numLines lines, the oldest at index firstLine
+    QVector<LineItem> lines;
+    int firstLine;
+    int numLines;
+    QVector<LineItem> pendingLines;
+
+    // Lines are numbered in the order they were appended; firstSeq is
+    // the number of line(0). currentSeq is the line highlighted by
+    // setCurrentLine(), or NoLine.
+    enum : quint64 { NoLine = ~Q_UINT64_C(0) };
+    quint64 firstSeq;
+    quint64 currentSeq;
+
+    // Search index: for each block of BlockLines consecutive lines, the
+    // set of (hashed, case-folded) character trigrams they contain. A
+    // block that lacks one of the trigrams of the search string cannot
+    // contain a match. blocks.front() is block number firstBlock.
+    enum { BlockLines = 64, BlockBits = 4096 };
+    typedef std::bitset<BlockBits> Block;
+    std::deque<Block> blocks;
+    quint64 firstBlock;
 
     unsigned int historySize;
     unsigned int minimumVisibleLines;
@@ -126,18 +165,25 @@ private:
 
     mutable struct Cache {
         enum { Dimensions = 1, FontMetrics = 2, All = FontMetrics | Dimensions };
-        Cache() : dirty(All) {}
+        Cache() : dirty(All)
+        {
+            dimensions.longestLineChars = 0;
+            dimensions.longestMeasuredLine = 0;
+            dimensions.longestLineLength = 0;
+        }
         int dirty;
 
         struct {
             int lineSpacing;
             int ascent;
             int averageCharWidth;
-            QVector<int> lineWidths;
         } fontMetrics;
 
+        // Lines are only measured when painted. Until then, the
+        // longest line is estimated from its number of characters.
         struct {
-            int indexOfLongestLine;
+            int longestLineChars;
+            int longestMeasuredLine;
             int longestLineLength;
         } dimensions;
     } cache;
@@ -214,8 +260,9 @@ void KDLogTextWidget::setLines(const QStringList &l)
 QStringList KDLogTextWidget::lines() const
 {
     QStringList result;
-    Q_FOREACH (const Private::LineItem &li, d->lines) {
-        result.push_back(li.text);
+    result.reserve(d->numLines + d->pendingLines.size());
+    for (int i = 0; i < d->numLines; ++i) {
+        result.push_back(d->line(i).text);
     }
     Q_FOREACH (const Private::LineItem &li, d->pendingLines) {
         result.push_back(li.text);
@@ -314,6 +361,94 @@ QSize KDLogTextWidget::sizeHint() const
     }
 }
 
+// The bit of the search index that stands for the trigram \a a \a b \a c
+// (case-folded). Uses the top 12 bits of the hash, one for each of
+// Private::BlockBits.
+static inline unsigned int trigram_bit(uint a, uint b, uint c)
+{
+    return ((a * 0x9E3779B1U) ^ (b * 0x85EBCA6BU) ^ (c * 0xC2B2AE35U)) >> 20;
+}
+
+template <typename F>
+static void for_each_trigram(const QString &text, F f)
+{
+    for (int i = 2, end = text.size(); i < end; ++i) {
+        f(trigram_bit(text[i - 2].toCaseFolded().unicode(),
+                      text[i - 1].toCaseFolded().unicode(),
+                      text[i].toCaseFolded().unicode()));
+    }
+}
+
+/*!
+  Returns the index of the first line at or after \a from that
+  contains \a text, or -1 if there is none. Lines not yet shown are
+  not searched.
+*/
+int KDLogTextWidget::findLine(const QString &text, int from, Qt::CaseSensitivity cs) const
+{
+    if (text.isEmpty()) {
+        return -1;
+    }
+    std::vector<unsigned int> needle;
+    for_each_trigram(text, [&needle](unsigned int bit) {
+        needle.push_back(bit);
+    });
+
+    int i = qMax(0, from);
+    while (i < d->numLines) {
+        const quint64 seq = d->firstSeq + i;
+        const Private::Block &block = d->blocks[seq / Private::BlockLines - d->firstBlock];
+        const int blockEnd = qMin<quint64>(d->numLines, i + Private::BlockLines - seq % Private::BlockLines);
+        if (std::all_of(needle.cbegin(), needle.cend(), [&block](unsigned int bit) {
+                return block.test(bit);
+            })) {
+            for (; i < blockEnd; ++i) {
+                if (d->line(i).text.contains(text, cs)) {
+                    return i;
+                }
+            }
+        } else {
+            i = blockEnd;
+        }
+    }
+    return -1;
+}
+
+/*!
+  Highlights line \a line and scrolls the view so that it is visible.
+  Pass -1 to remove the highlight. The highlight moves along with the
+  line as older lines are dropped.
+*/
+void KDLogTextWidget::setCurrentLine(int line)
+{
+    if (line < 0 || line >= d->numLines) {
+        d->currentSeq = Private::NoLine;
+        viewport()->update();
+        return;
+    }
+    d->currentSeq = d->firstSeq + line;
+    d->updateCache();
+    if (QScrollBar *const sb = verticalScrollBar()) {
+        const int y = line * d->cache.fontMetrics.lineSpacing;
+        if (y < sb->value() || y + d->cache.fontMetrics.lineSpacing > sb->value() + viewport()->height()) {
+            sb->setValue(y - viewport()->height() / 2);
+        }
+    }
+    viewport()->update();
+}
+
+/*!
+  Returns the index of the line highlighted by setCurrentLine(), or -1
+  if there is none (anymore).
+*/
+int KDLogTextWidget::currentLine() const
+{
+    if (d->currentSeq == Private::NoLine || d->currentSeq < d->firstSeq) {
+        return -1;
+    }
+    return static_cast<int>(d->currentSeq - d->firstSeq);
+}
+
 /*!
   Clears the text.
 
@@ -323,7 +458,14 @@ void KDLogTextWidget::clear()
 {
     d->timer.stop();
     d->lines.clear();
+    d->firstLine = 0;
+    d->numLines = 0;
+    d->firstSeq = 0;
+    d->currentSeq = Private::NoLine;
+    d->blocks.clear();
+    d->firstBlock = 0;
     d->pendingLines.clear();
+    d->cache.dimensions.longestLineChars = 0;
     d->styleByID.clear();
     d->idByStyle.clear();
     d->cache.dirty = Private::Cache::All;
@@ -355,6 +497,24 @@ void KDLogTextWidget::message(const QString &str)
     d->triggerTimer();
 }
 
+/*!
+  \overload
+
+  Appends all of \a strs in one go, using the default text color.
+*/
+void KDLogTextWidget::messages(const QStringList &strs)
+{
+    if (strs.empty()) {
+        return;
+    }
+    d->pendingLines.reserve(d->pendingLines.size() + strs.size());
+    for (const QString &str : strs) {
+        const Private::LineItem li = { str, 0 };
+        d->pendingLines.push_back(li);
+    }
+    d->triggerTimer();
+}
+
 void KDLogTextWidget::paintEvent(QPaintEvent *e)
 {
 
@@ -408,13 +568,31 @@ void KDLogTextWidget::paintEvent(QPaintEvent *e)
     }
 
     // ### unused optimization: paint lines by styles to minimise pen changes.
-    for (int i = visibleLines.first, end = visibleLines.second; i != end; ++i) {
-        const Private::LineItem &li = d->lines[i];
+    const QFontMetrics &fm = fontMetrics();
+    int longestVisibleLine = 0;
+    for (int i = visibleLines.first, end = qMin(visibleLines.second, d->numLines); i < end; ++i) {
+        const Private::LineItem &li = d->line(i);
         Q_ASSERT(!li.styleID || d->styleByID.contains(li.styleID));
         const Private::Style &st = li.styleID ? d->styleByID[li.styleID] : defaultStyle;
 
-        p.setPen(st.color);
+        if (d->firstSeq + i == d->currentSeq) {
+            p.setPen(Qt::NoPen);
+            p.setBrush(palette().highlight());
+            p.drawRect(d->lineRect(i));
+            p.setPen(palette().highlightedText().color());
+        } else {
+            p.setPen(st.color);
+        }
         p.drawText(0, i * cache.fontMetrics.lineSpacing + cache.fontMetrics.ascent, li.text);
+        longestVisibleLine = qMax(longestVisibleLine, fm.width(li.text));
+    }
+
+    if (longestVisibleLine > cache.dimensions.longestMeasuredLine) {
+        d->cache.dimensions.longestMeasuredLine = longestVisibleLine;
+        if (longestVisibleLine > cache.dimensions.longestLineLength) {
+            d->cache.dimensions.longestLineLength = longestVisibleLine;
+            d->updateScrollRanges();
+        }
     }
 
 }
@@ -445,7 +623,13 @@ KDLogTextWidget::Private::Private(KDLogTextWidget *qq)
       styleByID(),
       idByStyle(),
       lines(),
+      firstLine(0),
+      numLines(0),
       pendingLines(),
+      firstSeq(0),
+      currentSeq(NoLine),
+      blocks(),
+      firstBlock(0),
       historySize(0xFFFFFFFF),
       minimumVisibleLines(1),
       minimumVisibleColumns(1),
@@ -473,26 +657,14 @@ void KDLogTextWidget::Private::updateCache() const
         cache.fontMetrics.lineSpacing = fm.lineSpacing();
         cache.fontMetrics.ascent = fm.ascent();
         cache.fontMetrics.averageCharWidth = fm.averageCharWidth();
-
-        QVector<int> &lw = cache.fontMetrics.lineWidths;
-        lw.clear();
-        lw.reserve(lines.size());
-        Q_FOREACH (const LineItem &li, lines) {
-            lw.push_back(fm.width(li.text));
-        }
+        // measured with the old font:
+        cache.dimensions.longestMeasuredLine = 0;
     }
 
     if (cache.dirty >= Cache::Dimensions) {
-        const QVector<int> &lw = cache.fontMetrics.lineWidths;
-        const QVector<int>::const_iterator it =
-            std::max_element(lw.begin(), lw.end());
-        if (it == lw.end()) {
-            cache.dimensions.indexOfLongestLine = -1;
-            cache.dimensions.longestLineLength = 0;
-        } else {
-            cache.dimensions.indexOfLongestLine = it - lw.begin();
-            cache.dimensions.longestLineLength = *it;
-        }
+        cache.dimensions.longestLineLength
+            = qMax(cache.dimensions.longestMeasuredLine,
+                   cache.dimensions.longestLineChars * cache.fontMetrics.averageCharWidth);
     }
 
     cache.dirty = false;
@@ -516,32 +688,80 @@ unsigned int KDLogTextWidget::Private::findOrAddStyle(const Style &s)
 
 void KDLogTextWidget::Private::enforceHistorySize()
 {
-    const size_t numLimes = lines.size();
-    if (numLimes <= historySize) {
+    if (static_cast<unsigned int>(lines.size()) <= historySize) {
         return;
     }
-    const int remove = numLimes - historySize;
-    lines.erase(lines.begin(), lines.begin() + remove);
+    // keep the newest historySize lines, in a buffer no larger than that
+    const int keep = qMin<quint64>(numLines, historySize);
+    QVector<LineItem> kept;
+    kept.reserve(keep);
+    for (int i = numLines - keep; i < numLines; ++i) {
+        kept.push_back(line(i));
+    }
+    lines.swap(kept);
+    firstLine = 0;
+    firstSeq += numLines - keep;
+    numLines = keep;
+    dropIndexedLines();
+}
 
-    // can't quickly update the dimensions if the fontMetrics aren't uptodate.
-    if (cache.dirty & Cache::FontMetrics) {
-        cache.dirty |= Cache::Dimensions;
+void KDLogTextWidget::Private::appendLine(const LineItem &li)
+{
+    if (historySize == 0) {
         return;
     }
+    indexLine(firstSeq + numLines, li.text);
+    const int capacity = lines.size();
+    if (numLines == capacity) {
+        if (static_cast<unsigned int>(capacity) >= historySize) {
+            // full: overwrite the oldest line
+            lines[firstLine] = li;
+            firstLine = (firstLine + 1) % capacity;
+            ++firstSeq;
+            dropIndexedLines();
+            return;
+        }
+        // grow, unrolling the ring so that the oldest line comes first
+        const int newCapacity = static_cast<int>(qMin<quint64>(qMax(1024, 2 * capacity), qMin<quint64>(historySize, INT_MAX)));
+        QVector<LineItem> grown;
+        grown.reserve(newCapacity);
+        for (int i = 0; i < numLines; ++i) {
+            grown.push_back(line(i));
+        }
+        grown.resize(newCapacity);
+        lines.swap(grown);
+        firstLine = 0;
+    }
+    lines[(firstLine + numLines) % lines.size()] = li;
+    ++numLines;
+}
 
-    QVector<int> &lw = cache.fontMetrics.lineWidths;
-
-    Q_ASSERT(lw.size() > remove);
-    lw.erase(lw.begin(), lw.begin() + remove);
+void KDLogTextWidget::Private::indexLine(quint64 seq, const QString &text)
+{
+    const quint64 block = seq / BlockLines;
+    if (blocks.empty()) {
+        firstBlock = block;
+    }
+    while (firstBlock + blocks.size() <= block) {
+        blocks.emplace_back();
+    }
+    Block &bits = blocks[block - firstBlock];
+    for_each_trigram(text, [&bits](unsigned int bit) {
+        bits.set(bit);
+    });
+}
 
-    if (cache.dirty & Cache::Dimensions) {
+// drops the blocks of the search index that only hold dropped lines
+void KDLogTextWidget::Private::dropIndexedLines()
+{
+    if (numLines == 0) {
+        blocks.clear();
         return;
     }
-
-    if (cache.dimensions.indexOfLongestLine >= remove) {
-        cache.dimensions.indexOfLongestLine -= remove;
-    } else {
-        cache.dirty |= Cache::Dimensions;
+    const quint64 block = firstSeq / BlockLines;
+    while (!blocks.empty() && firstBlock < block) {
+        blocks.pop_front();
+        ++firstBlock;
     }
 }
 
@@ -563,7 +783,7 @@ void KDLogTextWidget::Private::updateScrollRanges()
     updateCache();
 
     if (QScrollBar *const sb = q->verticalScrollBar()) {
-        const int document = lines.size() * cache.fontMetrics.lineSpacing;
+        const int document = numLines * cache.fontMetrics.lineSpacing;
         const int viewport = q->viewport()->height();
         const int singleStep = cache.fontMetrics.lineSpacing;
         set_scrollbar_properties(*sb, document, viewport, singleStep, Qt::Vertical);
@@ -583,35 +803,18 @@ void KDLogTextWidget::Private::addPendingLines()
         return;
     }
 
-    const int oldNumLines = lines.size();
-
-    lines += pendingLines;
-
-    // if the cache isn't dirty, we can quickly update it without
-    // invalidation:
-
-    if (!cache.dirty) {
-
-        // update fontMetrics:
-        const QFontMetrics &fm = q->fontMetrics();
-        QVector<int> plw;
-        plw.reserve(pendingLines.size());
-        Q_FOREACH (const LineItem &li, pendingLines) {
-            plw.push_back(fm.width(li.text));
-        }
-
-        // update dimensions:
-        const QVector<int>::const_iterator it =
-            std::max_element(plw.constBegin(), plw.constEnd());
-        if (*it >= cache.dimensions.longestLineLength) {
-            cache.dimensions.longestLineLength = *it;
-            cache.dimensions.indexOfLongestLine = oldNumLines + (it - plw.constBegin());
-        }
+    int longestPendingLine = 0;
+    for (const LineItem &li : pendingLines) {
+        longestPendingLine = qMax(longestPendingLine, li.text.size());
+        appendLine(li);
     }
-
     pendingLines.clear();
 
-    enforceHistorySize();
+    if (longestPendingLine > cache.dimensions.longestLineChars) {
+        cache.dimensions.longestLineChars = longestPendingLine;
+        cache.dirty |= Cache::Dimensions;
+    }
+
     updateScrollRanges();
     q->viewport()->update();
 }
@@ -626,8 +829,8 @@ int KDLogTextWidget::Private::lineByYCoordinate(int y) const
     if (raw < 0) {
         return -1;
     }
-    if (raw >= lines.size()) {
-        return lines.size() - 1;
+    if (raw >= numLines) {
+        return numLines - 1;
     }
     return raw;
 }
@@ -65,10 +65,16 @@ public:
     QSize minimumSizeHint() const override;
     QSize sizeHint() const override;
 
+    int findLine(const QString &text, int from = 0, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
+    void setCurrentLine(int line);
+    int currentLine() const;
+
 public Q_SLOTS:
     void clear();
     void message(const QString &msg, const QColor &color);
     void message(const QString &msg);
+    void messages(const QStringList &msgs);
 
 protected:
     void paintEvent(QPaintEvent *) override;
@@ -162,6 +162,13 @@ KWatchGnuPGConfig::KWatchGnuPGConfig(QWidget *parent)
 
     connect(mWordWrapCB, &QCheckBox::clicked, this, &KWatchGnuPGConfig::slotChanged);
 
+    ++row;
+    mSpillToDiskCB = new QCheckBox(i18n("&Keep the complete log in a temporary file"), group);
+    mSpillToDiskCB->setToolTip(i18n("Lines dropped from the window because of the history size are still saved with \"Save As\"."));
+    glay->addWidget(mSpillToDiskCB, row, 0, 1, 3);
+
+    connect(mSpillToDiskCB, &QCheckBox::clicked, this, &KWatchGnuPGConfig::slotChanged);
+
     vlay->addStretch(1);
 
     connect(okButton, &QPushButton::clicked, this, &KWatchGnuPGConfig::slotSave);
@@ -184,6 +191,7 @@ void KWatchGnuPGConfig::loadConfig()
     const KConfigGroup logWindow(KSharedConfig::openConfig(), "LogWindow");
     mLoglenSB->setValue(logWindow.readEntry("MaxLogLen", 10000));
     mWordWrapCB->setChecked(logWindow.readEntry("WordWrap", false));
+    mSpillToDiskCB->setChecked(logWindow.readEntry("SpillToDisk", false));
 
     mButtonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
 }
@@ -198,6 +206,7 @@ void KWatchGnuPGConfig::saveConfig()
     KConfigGroup logWindow(KSharedConfig::openConfig(), "LogWindow");
     logWindow.writeEntry("MaxLogLen", mLoglenSB->value());
     logWindow.writeEntry("WordWrap", mWordWrapCB->isChecked());
+    logWindow.writeEntry("SpillToDisk", mSpillToDiskCB->isChecked());
 
     KSharedConfig::openConfig()->sync();
 
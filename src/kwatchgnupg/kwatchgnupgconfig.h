@@ -68,6 +68,7 @@ private:
     QComboBox *mLogLevelCB;
     KPluralHandlingSpinBox *mLoglenSB;
     QCheckBox *mWordWrapCB;
+    QCheckBox *mSpillToDiskCB;
     QDialogButtonBox *mButtonBox;
 };
 
@@ -41,6 +41,7 @@
 #include <QGpgME/CryptoConfig>
 
 #include "kdlogtextwidget.h"
+#include "logreader.h"
 
 #include <kmessagebox.h>
 #include <KLocalizedString>
@@ -56,6 +57,7 @@
 #include <KConfigGroup>
 
 #include <QEventLoop>
+#include <QInputDialog>
 #include <QTextStream>
 #include <QDateTime>
 #include <QFileDialog>
@@ -72,6 +74,11 @@ KWatchGnuPGMainWindow::KWatchGnuPGMainWindow(QWidget *parent)
 
     setCentralWidget(mCentralWidget);
 
+    mReader = new KWatchGnuPGLogReader(this);
+    connect(mReader, &KWatchGnuPGLogReader::linesAvailable,
+            this, &KWatchGnuPGMainWindow::slotLinesAvailable);
+    mReader->start();
+
     mWatcher = new KProcess;
     connect(mWatcher, SIGNAL(finished(int,QProcess::ExitStatus)),
             this, SLOT(slotWatcherExited(int,QProcess::ExitStatus)));
@@ -97,7 +104,8 @@ KWatchGnuPGMainWindow::~KWatchGnuPGMainWindow()
 void KWatchGnuPGMainWindow::slotClear()
 {
     mCentralWidget->clear();
-    mCentralWidget->message(i18n("[%1] Log cleared", QDateTime::currentDateTime().toString(Qt::ISODate)));
+    mReader->clearSpillFile();
+    mReader->addMessage(i18n("[%1] Log cleared", QDateTime::currentDateTime().toString(Qt::ISODate)));
 }
 
 void KWatchGnuPGMainWindow::createActions()
@@ -108,6 +116,8 @@ void KWatchGnuPGMainWindow::createActions()
     connect(action, &QAction::triggered, this, &KWatchGnuPGMainWindow::slotClear);
     actionCollection()->setDefaultShortcut(action, QKeySequence(Qt::CTRL + Qt::Key_L));
     (void)KStandardAction::saveAs(this, SLOT(slotSaveAs()), actionCollection());
+    (void)KStandardAction::find(this, SLOT(slotFind()), actionCollection());
+    (void)KStandardAction::findNext(this, SLOT(slotFindNext()), actionCollection());
     (void)KStandardAction::close(this, SLOT(close()), actionCollection());
     (void)KStandardAction::quit(this, SLOT(slotQuit()), actionCollection());
     (void)KStandardAction::preferences(this, SLOT(slotConfigure()), actionCollection());
@@ -135,7 +145,7 @@ void KWatchGnuPGMainWindow::startWatcher()
         while (mWatcher->state() == QProcess::Running) {
             qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
         }
-        mCentralWidget->message(i18n("[%1] Log stopped", QDateTime::currentDateTime().toString(Qt::ISODate)));
+        mReader->addMessage(i18n("[%1] Log stopped", QDateTime::currentDateTime().toString(Qt::ISODate)));
     }
     mWatcher->clearProgram();
 
@@ -152,7 +162,7 @@ void KWatchGnuPGMainWindow::startWatcher()
     if (!ok) {
         KMessageBox::sorry(this, i18n("The watchgnupg logging process could not be started.\nPlease install watchgnupg somewhere in your $PATH.\nThis log window is unable to display any useful information."));
     } else {
-        mCentralWidget->message(i18n("[%1] Log started", QDateTime::currentDateTime().toString(Qt::ISODate)));
+        mReader->addMessage(i18n("[%1] Log started", QDateTime::currentDateTime().toString(Qt::ISODate)));
     }
     connect(mWatcher, SIGNAL(finished(int,QProcess::ExitStatus)),
             this, SLOT(slotWatcherExited(int,QProcess::ExitStatus)));
@@ -195,7 +205,7 @@ void KWatchGnuPGMainWindow::setGnuPGConfig()
 void KWatchGnuPGMainWindow::slotWatcherExited(int, QProcess::ExitStatus)
 {
     if (KMessageBox::questionYesNo(this, i18n("The watchgnupg logging process died.\nDo you want to try to restart it?"), QString(), KGuiItem(i18n("Try Restart")), KGuiItem(i18n("Do Not Try"))) == KMessageBox::Yes) {
-        mCentralWidget->message(i18n("====== Restarting logging process ====="));
+        mReader->addMessage(i18n("====== Restarting logging process ====="));
         startWatcher();
     } else {
         KMessageBox::sorry(this, i18n("The watchgnupg logging process is not running.\nThis log window is unable to display any useful information."));
@@ -207,20 +217,17 @@ void KWatchGnuPGMainWindow::slotReadStdout()
     if (!mWatcher) {
         return;
     }
-    while (mWatcher->canReadLine()) {
-        QString str = QString::fromUtf8(mWatcher->readLine());
-        if (str.endsWith(QLatin1Char('\n'))) {
-            str.chop(1);
-        }
-        if (str.endsWith(QLatin1Char('\r'))) {
-            str.chop(1);
-        }
-        mCentralWidget->message(str);
-        if (!isVisible()) {
-            // Change tray icon to show something happened
-            // PENDING(steffen)
-            mSysTray->setAttention(true);
-        }
+    // line splitting and decoding happen in the reader thread
+    mReader->addData(mWatcher->readAllStandardOutput());
+}
+
+void KWatchGnuPGMainWindow::slotLinesAvailable(const QStringList &lines)
+{
+    mCentralWidget->messages(lines);
+    if (!isVisible()) {
+        // Change tray icon to show something happened
+        // PENDING(steffen)
+        mSysTray->setAttention(true);
     }
 }
 
@@ -236,6 +243,13 @@ void KWatchGnuPGMainWindow::slotSaveAs()
     if (filename.isEmpty()) {
         return;
     }
+    if (mReader->isSpillToDiskEnabled()) {
+        QString errorString;
+        if (!mReader->saveSpillFile(filename, &errorString))
+            KMessageBox::information(this, i18n("Could not save file %1: %2",
+                                                filename, errorString));
+        return;
+    }
     QFile file(filename);
     if (file.open(QIODevice::WriteOnly)) {
         QTextStream(&file) << mCentralWidget->text();
@@ -244,6 +258,36 @@ void KWatchGnuPGMainWindow::slotSaveAs()
                                             filename, file.errorString()));
 }
 
+void KWatchGnuPGMainWindow::slotFind()
+{
+    bool ok = false;
+    const QString text = QInputDialog::getText(this, i18n("Find"), i18n("Find text:"), QLineEdit::Normal, mFindText, &ok);
+    if (!ok || text.isEmpty()) {
+        return;
+    }
+    mFindText = text;
+    mCentralWidget->setCurrentLine(-1);
+    slotFindNext();
+}
+
+void KWatchGnuPGMainWindow::slotFindNext()
+{
+    if (mFindText.isEmpty()) {
+        slotFind();
+        return;
+    }
+    int line = mCentralWidget->findLine(mFindText, mCentralWidget->currentLine() + 1);
+    if (line < 0) {
+        // wrap around
+        line = mCentralWidget->findLine(mFindText);
+    }
+    if (line < 0) {
+        KMessageBox::information(this, i18n("Text \"%1\" not found.", mFindText));
+        return;
+    }
+    mCentralWidget->setCurrentLine(line);
+}
+
 void KWatchGnuPGMainWindow::slotQuit()
 {
     disconnect(mWatcher, SIGNAL(finished(int,QProcess::ExitStatus)),
@@ -269,6 +313,10 @@ void KWatchGnuPGMainWindow::slotReadConfig()
     const KConfigGroup config(KSharedConfig::openConfig(), "LogWindow");
     const int maxLogLen = config.readEntry("MaxLogLen", 10000);
     mCentralWidget->setHistorySize(maxLogLen < 1 ? -1 : maxLogLen);
+    const bool spillToDisk = config.readEntry("SpillToDisk", false);
+    if (spillToDisk != mReader->isSpillToDiskEnabled()) {
+        mReader->setSpillToDiskEnabled(spillToDisk, mCentralWidget->lines());
+    }
     setGnuPGConfig();
     startWatcher();
 }
@@ -40,6 +40,7 @@ class KWatchGnuPGTray;
 class KWatchGnuPGConfig;
 class KProcess;
 class KDLogTextWidget;
+class KWatchGnuPGLogReader;
 
 class KWatchGnuPGMainWindow : public KXmlGuiWindow
 {
@@ -51,8 +52,11 @@ public:
 private Q_SLOTS:
     void slotWatcherExited(int, QProcess::ExitStatus);
     void slotReadStdout();
+    void slotLinesAvailable(const QStringList &lines);
 
     void slotSaveAs();
+    void slotFind();
+    void slotFindNext();
     void slotQuit();
     void slotClear();
 
@@ -73,10 +77,12 @@ private:
     void setGnuPGConfig();
 
     KProcess *mWatcher;
+    KWatchGnuPGLogReader *mReader;
 
     KDLogTextWidget *mCentralWidget;
     KWatchGnuPGTray *mSysTray;
     KWatchGnuPGConfig *mConfig;
+    QString mFindText;
 };
 
 #endif /* KWATCHGNUPGMAINWIN_H */
@@ -0,0 +1,222 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    kwatchgnupg/logreader.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "logreader.h"
+
+#include "kwatchgnupg_debug.h"
+
+#include <QMutexLocker>
+#include <QTemporaryFile>
+
+KWatchGnuPGLogReader::KWatchGnuPGLogReader(QObject *parent)
+    : QThread(parent),
+      mMutex(),
+      mCondition(),
+      mQueue(),
+      mStop(false),
+      mPartialLine(),
+      mSpillMutex(),
+      mSpillFile()
+{
+}
+
+KWatchGnuPGLogReader::~KWatchGnuPGLogReader()
+{
+    stop();
+    wait();
+}
+
+void KWatchGnuPGLogReader::addData(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+    const QMutexLocker locker(&mMutex);
+    mQueue.push_back({ data, QString() });
+    mCondition.wakeOne();
+}
+
+void KWatchGnuPGLogReader::addMessage(const QString &message)
+{
+    // routed through the queue so that it keeps its place among the log lines
+    const QMutexLocker locker(&mMutex);
+    mQueue.push_back({ QByteArray(), message });
+    mCondition.wakeOne();
+}
+
+void KWatchGnuPGLogReader::stop()
+{
+    const QMutexLocker locker(&mMutex);
+    mStop = true;
+    mCondition.wakeOne();
+}
+
+void KWatchGnuPGLogReader::setSpillToDiskEnabled(bool enabled, const QStringList &existingLines)
+{
+    const QMutexLocker locker(&mSpillMutex);
+    if (!enabled) {
+        mSpillFile.reset();
+        return;
+    }
+    if (mSpillFile) {
+        return;
+    }
+    std::unique_ptr<QTemporaryFile> file(new QTemporaryFile);
+    if (!file->open()) {
+        qCWarning(KWATCHGNUPG_LOG) << "Could not create spill file:" << file->errorString();
+        return;
+    }
+    // start with what is already displayed, so that "Save As" doesn't lose it
+    for (const QString &line : existingLines) {
+        file->write(line.toUtf8());
+        file->write("\n", 1);
+    }
+    mSpillFile = std::move(file);
+}
+
+bool KWatchGnuPGLogReader::isSpillToDiskEnabled() const
+{
+    const QMutexLocker locker(&mSpillMutex);
+    return mSpillFile != nullptr;
+}
+
+void KWatchGnuPGLogReader::clearSpillFile()
+{
+    const QMutexLocker locker(&mSpillMutex);
+    if (mSpillFile) {
+        mSpillFile->resize(0);
+        mSpillFile->seek(0);
+    }
+}
+
+bool KWatchGnuPGLogReader::saveSpillFile(const QString &fileName, QString *errorString) const
+{
+    const QMutexLocker locker(&mSpillMutex);
+    if (!mSpillFile) {
+        return false;
+    }
+    mSpillFile->flush();
+    // the file dialog already asked before overwriting an existing file
+    QFile target(fileName);
+    if (target.exists() && !target.remove()) {
+        if (errorString) {
+            *errorString = target.errorString();
+        }
+        return false;
+    }
+    QFile source(mSpillFile->fileName());
+    if (!source.copy(fileName)) {
+        if (errorString) {
+            *errorString = source.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+void KWatchGnuPGLogReader::run()
+{
+    std::vector<Chunk> chunks;
+    Q_FOREVER {
+        {
+            QMutexLocker locker(&mMutex);
+            while (mQueue.empty() && !mStop) {
+                mCondition.wait(&mMutex);
+            }
+            if (mStop) {
+                return;
+            }
+            chunks.swap(mQueue);
+        }
+
+        QStringList lines;
+        QByteArray spill;
+        for (const Chunk &chunk : chunks) {
+            if (chunk.data.isEmpty()) {
+                // a status message goes between the complete lines; an
+                // unfinished line stays buffered until its newline arrives
+                lines.push_back(chunk.message);
+                spill += chunk.message.toUtf8();
+                spill += '\n';
+            } else {
+                processData(chunk.data, lines, spill);
+            }
+        }
+        chunks.clear();
+
+        writeSpill(spill);
+        if (!lines.empty()) {
+            Q_EMIT linesAvailable(lines);
+        }
+    }
+}
+
+void KWatchGnuPGLogReader::processData(const QByteArray &data, QStringList &lines, QByteArray &spill)
+{
+    mPartialLine += data;
+    const char *const begin = mPartialLine.constData();
+    const int size = mPartialLine.size();
+    int start = 0;
+    Q_FOREVER {
+        const int nl = mPartialLine.indexOf('\n', start);
+        if (nl < 0) {
+            break;
+        }
+        int end = nl;
+        if (end > start && begin[end - 1] == '\r') {
+            --end;
+        }
+        lines.push_back(QString::fromUtf8(begin + start, end - start));
+        spill.append(begin + start, end - start);
+        spill += '\n';
+        start = nl + 1;
+    }
+    if (start == size) {
+        mPartialLine.clear();
+    } else if (start > 0) {
+        mPartialLine.remove(0, start);
+    }
+}
+
+void KWatchGnuPGLogReader::writeSpill(const QByteArray &spill)
+{
+    if (spill.isEmpty()) {
+        return;
+    }
+    const QMutexLocker locker(&mSpillMutex);
+    if (mSpillFile && mSpillFile->write(spill) != spill.size()) {
+        qCWarning(KWATCHGNUPG_LOG) << "Writing to spill file failed:" << mSpillFile->errorString();
+        mSpillFile.reset();
+    }
+}
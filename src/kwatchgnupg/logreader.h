@@ -0,0 +1,99 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    kwatchgnupg/logreader.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef KWATCHGNUPG_LOGREADER_H
+#define KWATCHGNUPG_LOGREADER_H
+
+#include <QThread>
+#include <QByteArray>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include <memory>
+#include <vector>
+
+class QFile;
+
+/*!
+  Splits the raw output of watchgnupg into lines off the GUI thread.
+
+  Data passed to addData() is decoded in large blocks and handed back
+  in batches through linesAvailable(). If enabled, every line is also
+  appended to a temporary file, so the complete log can be saved with
+  a plain file copy regardless of the history size of the log window.
+*/
+class KWatchGnuPGLogReader : public QThread
+{
+    Q_OBJECT
+public:
+    explicit KWatchGnuPGLogReader(QObject *parent = nullptr);
+    ~KWatchGnuPGLogReader() override;
+
+    void addData(const QByteArray &data);
+    void addMessage(const QString &message);
+
+    void setSpillToDiskEnabled(bool enabled, const QStringList &existingLines = QStringList());
+    bool isSpillToDiskEnabled() const;
+
+    void clearSpillFile();
+    bool saveSpillFile(const QString &fileName, QString *errorString) const;
+
+    void stop();
+
+Q_SIGNALS:
+    void linesAvailable(const QStringList &lines);
+
+protected:
+    void run() override;
+
+private:
+    struct Chunk {
+        QByteArray data;
+        QString message;
+    };
+
+    void processData(const QByteArray &data, QStringList &lines, QByteArray &spill);
+    void writeSpill(const QByteArray &spill);
+
+    mutable QMutex mMutex;
+    QWaitCondition mCondition;
+    std::vector<Chunk> mQueue;
+    bool mStop;
+
+    QByteArray mPartialLine;
+
+    mutable QMutex mSpillMutex;
+    std::unique_ptr<QFile> mSpillFile;
+};
+
+#endif // KWATCHGNUPG_LOGREADER_H
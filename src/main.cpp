@@ -45,6 +45,7 @@
 
 #include <utils/gnupg-helper.h>
 #include <utils/archivedefinition.h>
+#include <utils/keylistsnapshot.h>
 #include "utils/kuniqueservice.h"
 
 #include <uiserver/uiserver.h>
@@ -66,6 +67,7 @@
 #include <uiserver/verifychecksumscommand.h>
 
 #include <Libkleo/ChecksumDefinition>
+#include <Libkleo/KeyCache>
 
 #include "kleopatra_debug.h"
 #include "kleopatra_options.h"
@@ -105,11 +107,19 @@ static bool selfCheck()
     }
 }
 
-static void fillKeyCache(Kleo::UiServer *server)
+static void fillKeyCache(Kleo::UiServer *server, const QTime &timer)
 {
     Kleo::ReloadKeysCommand *cmd = new Kleo::ReloadKeysCommand(nullptr);
     QObject::connect(cmd, SIGNAL(finished()), server, SLOT(enableCryptoCommands()));
+    QObject::connect(cmd, &Kleo::Command::finished, server, [&timer]() {
+        qCDebug(KLEOPATRA_LOG) << "Startup timing:" << timer.elapsed() << "ms elapsed: Key cache filled";
+    });
     cmd->start();
+
+    // Remember the result for the key cache overlay of the next start
+    QObject::connect(Kleo::KeyCache::instance().get(), &Kleo::KeyCache::keyListingDone, server, []() {
+        Kleo::saveKeyListSnapshot(Kleo::KeyCache::instance()->keys());
+    });
 }
 
 int main(int argc, char **argv)
@@ -228,12 +238,16 @@ int main(int argc, char **argv)
         app.restoreMainWindow();
     }
 
+    // The self-check runs concurrently with the initial key listing; it
+    // only keeps the event loop busy until its results are in.
+    fillKeyCache(&server, timer);
+    qCDebug(KLEOPATRA_LOG) << "Startup timing:" << timer.elapsed() << "ms elapsed: Key listing started";
+
     if (!selfCheck()) {
         return EXIT_FAILURE;
     }
     qCDebug(KLEOPATRA_LOG) << "Startup timing:" << timer.elapsed() << "ms elapsed: SelfCheck completed";
 
-    fillKeyCache(&server);
 #ifndef QT_NO_SYSTEMTRAYICON
     app.startMonitoringSmartCard();
 #endif
@@ -250,6 +264,12 @@ int main(int argc, char **argv)
 
     rc = app.exec();
 
+    // Imports and deletions since the last key listing have changed the
+    // keyrings, so record the current state of the cache once more.
+    if (Kleo::KeyCache::instance()->initialized()) {
+        Kleo::saveKeyListSnapshot(Kleo::KeyCache::instance()->keys(), true);
+    }
+
     app.setIgnoreNewInstance(true);
     QObject::disconnect(&server, &Kleo::UiServer::startKeyManagerRequested, &app, &KleopatraApplication::openOrRaiseMainWindow);
     QObject::disconnect(&server, &Kleo::UiServer::startConfigDialogRequested, &app, &KleopatraApplication::openOrRaiseConfigDialog);
@@ -43,7 +43,12 @@
 #include <KLocalizedString>
 
 #include <QProcess>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
+#include <QFileInfo>
+
+#include <gpgme++/engineinfo.h>
 
 
 using namespace Kleo;
@@ -56,11 +61,15 @@ class GpgConfCheck : public SelfTestImplementation
 {
     QString m_component;
 public:
-    explicit GpgConfCheck(const char *component)
+    explicit GpgConfCheck(const char *component, bool cachedPass = false)
         : SelfTestImplementation(i18nc("@title", "%1 Configuration Check", component  && * component ? QLatin1String(component) : QLatin1String("gpgconf"))),
           m_component(QLatin1String(component))
     {
-        runTest();
+        if (cachedPass) {
+            m_passed = true;
+        } else {
+            runTest();
+        }
     }
 
     QStringList arguments() const
@@ -161,3 +170,45 @@ std::shared_ptr<SelfTest> Kleo::makeGpgConfCheckConfigurationSelfTest(const char
 {
     return std::shared_ptr<SelfTest>(new GpgConfCheck(component));
 }
+
+std::shared_ptr<SelfTest> Kleo::makeCachedGpgConfCheckConfigurationSelfTest(const char *component)
+{
+    return std::shared_ptr<SelfTest>(new GpgConfCheck(component, true));
+}
+
+static void addFileToFingerprint(QCryptographicHash &hash, const QString &fileName)
+{
+    const QFileInfo fi(fileName);
+    hash.addData(fileName.toUtf8());
+    if (fi.exists()) {
+        hash.addData(QByteArray::number(fi.size()));
+        hash.addData(QByteArray::number(fi.lastModified().toMSecsSinceEpoch()));
+    }
+    hash.addData("\n", 1);
+}
+
+QString Kleo::gpgConfCheckFingerprint()
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    static const GpgME::Engine engines[] = { GpgME::GpgConfEngine, GpgME::GpgEngine, GpgME::GpgSMEngine };
+    for (const GpgME::Engine engine : engines) {
+        const GpgME::EngineInfo info = GpgME::engineInfo(engine);
+        hash.addData(info.version() ? info.version() : "");
+        addFileToFingerprint(hash, info.fileName() ? QFile::decodeName(info.fileName()) : QString());
+    }
+
+    static const char *const configFiles[] = {
+        "gpg.conf", "gpgsm.conf", "gpg-agent.conf", "scdaemon.conf", "dirmngr.conf", "common.conf",
+    };
+    const QDir homeDir(gnupgHomeDirectory());
+    for (const char *file : configFiles) {
+        addFileToFingerprint(hash, homeDir.absoluteFilePath(QLatin1String(file)));
+    }
+    const QString sysconfDir = gpgConfListDir("sysconfdir");
+    if (!sysconfDir.isEmpty()) {
+        addFileToFingerprint(hash, QDir(sysconfDir).absoluteFilePath(QStringLiteral("gpgconf.conf")));
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
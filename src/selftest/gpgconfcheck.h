@@ -37,6 +37,8 @@
 
 #include <memory>
 
+class QString;
+
 namespace Kleo
 {
 
@@ -44,6 +46,13 @@ class SelfTest;
 
 std::shared_ptr<SelfTest> makeGpgConfCheckConfigurationSelfTest(const char *component = nullptr);
 
+/* A check for @p component that passed before; doesn't run gpgconf. */
+std::shared_ptr<SelfTest> makeCachedGpgConfCheckConfigurationSelfTest(const char *component = nullptr);
+
+/* Changes whenever the result of the configuration checks may change:
+   covers the GnuPG binaries (versions, sizes, mtimes) and config files. */
+QString gpgConfCheckFingerprint();
+
 }
 
 #endif /* __KLEOPATRA_SELFTEST_GPGCONFCHECK_H__ */
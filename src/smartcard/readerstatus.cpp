@@ -189,7 +189,7 @@ static std::unique_ptr<DefaultAssuanTransaction> gpgagent_transact(std::shared_p
     return std::unique_ptr<DefaultAssuanTransaction>(dynamic_cast<DefaultAssuanTransaction*>(t.release()));
 }
 
-const std::vector< std::pair<std::string, std::string> > gpgagent_statuslines(std::shared_ptr<Context> gpgAgent, const char *what, Error &err)
+const std::vector< std::pair<std::string, std::string> > gpgagent_statuslines(std::shared_ptr<Context> &gpgAgent, const char *what, Error &err)
 {
     const std::unique_ptr<DefaultAssuanTransaction> t = gpgagent_transact(gpgAgent, what, err);
     if (t.get()) {
@@ -202,7 +202,7 @@ const std::vector< std::pair<std::string, std::string> > gpgagent_statuslines(st
 
 }
 
-static const std::string gpgagent_status(const std::shared_ptr<Context> &gpgAgent, const char *what, Error &err)
+static const std::string gpgagent_status(std::shared_ptr<Context> &gpgAgent, const char *what, Error &err)
 {
     const auto lines = gpgagent_statuslines (gpgAgent, what, err);
     // The status is only the last attribute
@@ -324,14 +324,11 @@ static std::shared_ptr<Card> get_card_status(unsigned int slot, std::shared_ptr<
     if (ci->appType() == Card::NksApplication) {
         qCDebug(KLEOPATRA_LOG) << "get_card_status: found Netkey card" << ci->serialNumber().c_str() << "end";
         handle_netkey_card(ci, gpg_agent);
-        return ci;
     } else if (ci->appType() == Card::OpenPGPApplication) {
         qCDebug(KLEOPATRA_LOG) << "get_card_status: found OpenPGP card" << ci->serialNumber().c_str() << "end";
         handle_openpgp_card(ci, gpg_agent);
-        return ci;
     } else {
         qCDebug(KLEOPATRA_LOG) << "get_card_status: unhandled application:" << verbatimType.c_str();
-        return ci;
     }
 
     return ci;
@@ -429,20 +426,23 @@ private Q_SLOTS:
 
 private:
     void run() override {
-        while (true) {
-            std::shared_ptr<Context> gpgAgent;
+        // kept across iterations; reset on errors and then reconnected
+        std::shared_ptr<Context> gpgAgent;
 
+        while (true) {
             QByteArray command;
             bool nullSlot = false;
             std::list<Transaction> item;
             std::vector<std::shared_ptr<Card> > oldCards;
 
-            Error err;
-            std::unique_ptr<Context> c = Context::createForEngine(AssuanEngine, &err);
-            if (err.code() == GPG_ERR_NOT_SUPPORTED) {
-                return;
+            if (!gpgAgent) {
+                Error err;
+                std::unique_ptr<Context> c = Context::createForEngine(AssuanEngine, &err);
+                if (err.code() == GPG_ERR_NOT_SUPPORTED) {
+                    return;
+                }
+                gpgAgent = std::shared_ptr<Context>(c.release());
             }
-            gpgAgent = std::shared_ptr<Context>(c.release());
 
             KDAB_SYNCHRONIZED(m_mutex) {
 
@@ -464,6 +464,17 @@ private:
                 command = item.front().command;
                 nullSlot = !item.front().slot;
                 oldCards = m_cardInfos;
+
+                // one card scan answers all updates queued so far
+                if (nullSlot && command == updateTransaction.command) {
+                    for (auto it = m_transactions.begin(); it != m_transactions.end();) {
+                        if (!it->slot && it->command == updateTransaction.command) {
+                            it = m_transactions.erase(it);
+                        } else {
+                            ++it;
+                        }
+                    }
+                }
             }
 
             qCDebug(KLEOPATRA_LOG) << "ReaderStatusThread[2nd]: new iteration command=" << command << " ; nullSlot=" << nullSlot;
@@ -472,7 +483,7 @@ private:
                 return;    // quit
             }
 
-            if ((nullSlot && command == updateTransaction.command)) {
+            if (nullSlot && command == updateTransaction.command) {
 
                 std::vector<std::shared_ptr<Card> > newCards = update_cardinfo(gpgAgent);
 
@@ -519,7 +530,11 @@ private:
                 }
             } else {
                 GpgME::Error err;
-                (void)gpgagent_transact(gpgAgent, command.constData(), err);
+                if (gpgAgent) {
+                    (void)gpgagent_transact(gpgAgent, command.constData(), err);
+                } else {
+                    err = Error(gpg_error(GPG_ERR_NOT_SUPPORTED));
+                }
 
                 KDAB_SYNCHRONIZED(m_mutex)
                 // splice 'item' into m_finishedTransactions:
@@ -0,0 +1,182 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    uiserver/assuanlinewatcher.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "assuanlinewatcher.h"
+
+#include <kleo-assuan.h>
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cstring>
+
+#ifndef Q_OS_WIN32
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <errno.h>
+#endif
+
+using namespace Kleo;
+
+namespace
+{
+// how long to wait before looking again at a partially received line
+static const int PARTIAL_LINE_POLL_INTERVAL = 10; // ms
+
+static QAtomicInt pendingLineCount;
+
+enum LineState {
+    NoData,
+    PartialLine,
+    LineComplete
+};
+
+static LineState peekLine(qintptr fd)
+{
+#ifdef Q_OS_WIN32
+    // The socket emulation of libassuan does not allow peeking, so
+    // leave the reading to assuan_process_next().
+    Q_UNUSED(fd);
+    return LineComplete;
+#else
+    char buffer[ASSUAN_LINELENGTH];
+    const ssize_t n = ::recv(static_cast<int>(fd), buffer, sizeof buffer, MSG_PEEK | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return NoData;
+    }
+    if (n <= 0) {
+        // EOF or error; let libassuan find out about it
+        return LineComplete;
+    }
+    if (static_cast<size_t>(n) == sizeof buffer || std::memchr(buffer, '\n', n)) {
+        // libassuan will reject overlong lines, so pass them on, too
+        return LineComplete;
+    }
+    return PartialLine;
+#endif
+}
+}
+
+AssuanLineWatcher::AssuanLineWatcher(qintptr fd, QObject *parent)
+    : QObject(parent),
+      m_fd(fd),
+      m_notifier(nullptr),
+      m_pollTimer(nullptr),
+      m_unprocessedLines(0),
+      m_stopped(false)
+{
+}
+
+AssuanLineWatcher::~AssuanLineWatcher()
+{
+    // lines reported to a connection that went away in the meantime
+    pendingLineCount.fetchAndAddOrdered(-m_unprocessedLines.load());
+}
+
+// static
+qint64 AssuanLineWatcher::now()
+{
+    static QElapsedTimer timer;
+    static const bool started = (timer.start(), true);
+    Q_UNUSED(started);
+    return timer.nsecsElapsed() / 1000;
+}
+
+// static
+int AssuanLineWatcher::pendingLines()
+{
+    return pendingLineCount.load();
+}
+
+int AssuanLineWatcher::unprocessedLines() const
+{
+    return m_unprocessedLines.load();
+}
+
+void AssuanLineWatcher::lineProcessed()
+{
+    m_unprocessedLines.deref();
+    pendingLineCount.deref();
+}
+
+void AssuanLineWatcher::rearm()
+{
+    if (m_stopped) {
+        return;
+    }
+    // created lazily so that they belong to the thread we live in
+    if (!m_notifier) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &AssuanLineWatcher::checkForLine);
+        m_pollTimer = new QTimer(this);
+        m_pollTimer->setSingleShot(true);
+        m_pollTimer->setInterval(PARTIAL_LINE_POLL_INTERVAL);
+        connect(m_pollTimer, &QTimer::timeout, this, &AssuanLineWatcher::checkForLine);
+    }
+    m_notifier->setEnabled(true);
+}
+
+void AssuanLineWatcher::stop()
+{
+    m_stopped = true;
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+        m_pollTimer->stop();
+    }
+}
+
+void AssuanLineWatcher::checkForLine()
+{
+    if (m_stopped) {
+        return;
+    }
+    switch (peekLine(m_fd)) {
+    case NoData:
+        m_notifier->setEnabled(true);
+        return;
+    case PartialLine:
+        // The socket stays readable until the data is consumed, so
+        // the notifier would fire continuously. Poll instead.
+        m_notifier->setEnabled(false);
+        m_pollTimer->start();
+        return;
+    case LineComplete:
+        m_notifier->setEnabled(false);
+        m_unprocessedLines.ref();
+        Q_EMIT lineAvailable(now(), pendingLineCount.fetchAndAddOrdered(1) + 1);
+        return;
+    }
+}
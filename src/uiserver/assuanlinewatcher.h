@@ -0,0 +1,99 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    uiserver/assuanlinewatcher.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_UISERVER_ASSUANLINEWATCHER_H__
+#define __KLEOPATRA_UISERVER_ASSUANLINEWATCHER_H__
+
+#include <QAtomicInt>
+#include <QObject>
+
+class QSocketNotifier;
+class QTimer;
+
+namespace Kleo
+{
+
+/**
+ * @internal
+ * Watches the socket of an AssuanServerConnection.
+ *
+ * The watcher is meant to live in the UI server's I/O thread. It
+ * emits lineAvailable() only once a complete request line (or the end
+ * of the connection) has arrived, so that assuan_process_next(), which
+ * runs in the GUI thread, never blocks on a client that sends its
+ * request slowly. After lineAvailable() the watcher stays quiet until
+ * rearm() is called.
+ */
+class AssuanLineWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AssuanLineWatcher(qintptr fd, QObject *parent = nullptr);
+    ~AssuanLineWatcher();
+
+    /** Monotonic time stamp in microseconds, comparable across threads. */
+    static qint64 now();
+
+    /** The number of lines reported but not yet processed, over all connections. */
+    static int pendingLines();
+
+    /** The number of lines of this connection reported but not yet processed. */
+    int unprocessedLines() const;
+
+    /** To be called by the receiver of lineAvailable() after processing the line. */
+    void lineProcessed();
+
+public Q_SLOTS:
+    void rearm();
+    void stop();
+
+Q_SIGNALS:
+    /**
+     * A complete line can be read. @p detectedAt is a now() time stamp,
+     * @p queueDepth the value of pendingLines() including this line.
+     */
+    void lineAvailable(qint64 detectedAt, int queueDepth);
+
+private Q_SLOTS:
+    void checkForLine();
+
+private:
+    const qintptr m_fd;
+    QSocketNotifier *m_notifier;
+    QTimer *m_pollTimer;
+    QAtomicInt m_unprocessedLines;
+    bool m_stopped;
+};
+
+}
+
+#endif // __KLEOPATRA_UISERVER_ASSUANLINEWATCHER_H__
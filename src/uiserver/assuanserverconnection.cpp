@@ -42,7 +42,9 @@
 #include "assuanserverconnection.h"
 #include "assuancommand.h"
 #include "sessiondata.h"
+#include "assuanlinewatcher.h"
 
+#include <utils/auditlog.h>
 #include <utils/input.h>
 #include <utils/output.h>
 #include <utils/gnupg-helper.h>
@@ -64,8 +66,8 @@
 #include <KLocalizedString>
 #include <KWindowSystem>
 
-#include <QSocketNotifier>
 #include <QTimer>
+#include <QThread>
 #include <QVariant>
 #include <QPointer>
 #include <QFileInfo>
@@ -251,22 +253,44 @@ class AssuanServerConnection::Private : public QObject
     friend class ::Kleo::AssuanCommand;
     AssuanServerConnection *const q;
 public:
-    Private(assuan_fd_t fd_, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories_, AssuanServerConnection *qq);
+    Private(assuan_fd_t fd_, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories_, QThread *ioThread, AssuanServerConnection *qq);
     ~Private();
 
 Q_SIGNALS:
     void startKeyManager();
 
 public Q_SLOTS:
-    void slotReadActivity(int)
+    void slotLineAvailable(qint64 detectedAt, int queueDepth)
     {
-        Q_ASSERT(ctx);
+        if (!watcher) {
+            // stopped in the meantime
+            return;
+        }
+        watcher->lineProcessed();
+        const qint64 latency = AssuanLineWatcher::now() - detectedAt;
+        stats.totalQueueLatency += latency;
+        stats.maxQueueLatency = std::max(stats.maxQueueLatency, latency);
+        stats.maxQueueDepth = std::max(stats.maxQueueDepth, queueDepth);
+        processNextLine();
+    }
+
+    void processNextLine()
+    {
+        if (!ctx || closed) {
+            return;
+        }
+        const qint64 start = AssuanLineWatcher::now();
 #ifndef HAVE_ASSUAN2
-        if (const int err = assuan_process_next(ctx.get())) {
+        const int err = assuan_process_next(ctx.get());
+        const bool finished = err;
 #else
         int done = false;
-        if (const int err = assuan_process_next(ctx.get(), &done) || done) {
+        const int err = assuan_process_next(ctx.get(), &done);
+        const bool finished = err || done;
 #endif
+        ++stats.lines;
+        stats.totalProcessingTime += AssuanLineWatcher::now() - start;
+        if (finished) {
             //if ( err == -1 || gpg_err_code(err) == GPG_ERR_EOF ) {
             topHalfDeletion();
             if (nohupedCommands.empty()) {
@@ -276,6 +300,14 @@ public Q_SLOTS:
             //assuan_process_done( ctx.get(), err );
             //return;
             //}
+            return;
+        }
+        if (assuan_pending_line(ctx.get())) {
+            // libassuan has already buffered the next line; the socket
+            // may not become readable again for it
+            QTimer::singleShot(0, this, &Private::processNextLine);
+        } else if (watcher) {
+            QMetaObject::invokeMethod(watcher, "rearm", Qt::QueuedConnection);
         }
     }
 
@@ -301,6 +333,64 @@ private:
             return;
         }
         currentCommand.reset();
+        ++stats.commands;
+        stats.totalCommandTime += AssuanLineWatcher::now() - commandStartedAt;
+    }
+
+    // Must be called before the socket is closed: the I/O thread may
+    // be looking at it right now.
+    void stopWatcher()
+    {
+        if (!watcher) {
+            return;
+        }
+        if (watcher->thread()->isRunning() && watcher->thread() != QThread::currentThread()) {
+            QMetaObject::invokeMethod(watcher, "stop", Qt::BlockingQueuedConnection);
+        } else {
+            watcher->stop();
+        }
+        watcher->deleteLater();
+        watcher = nullptr;
+    }
+
+    QByteArray dumpStats() const
+    {
+        QByteArray result;
+        const auto add = [&result](const char *name, qint64 value) {
+            result += name;
+            result += ' ';
+            result += QByteArray::number(value);
+            result += '\n';
+        };
+        add("lines", stats.lines);
+        add("commands", stats.commands);
+        add("queue-latency-avg-us", stats.lines ? stats.totalQueueLatency / stats.lines : 0);
+        add("queue-latency-max-us", stats.maxQueueLatency);
+        add("queue-depth-current", watcher ? watcher->unprocessedLines() : 0);
+        // over all connections
+        add("process-queue-depth-max", stats.maxQueueDepth);
+        add("process-queue-depth-current", AssuanLineWatcher::pendingLines());
+        add("processing-avg-us", stats.lines ? stats.totalProcessingTime / stats.lines : 0);
+        add("command-avg-us", stats.commands ? stats.totalCommandTime / stats.commands : 0);
+        return result;
+    }
+
+    static QByteArray dumpSessionStatistics()
+    {
+        const SessionDataHandler::Statistics stats = SessionDataHandler::instance()->statistics();
+        return "active " + QByteArray::number(stats.active) + '\n'
+               + "stored " + QByteArray::number(stats.stored) + '\n'
+               + "created " + QByteArray::number(stats.created) + '\n'
+               + "expired " + QByteArray::number(stats.expired) + '\n';
+    }
+
+    static QByteArray dumpAuditLogStatistics()
+    {
+        const AuditLog::Statistics stats = AuditLog::statistics();
+        return "retained " + QByteArray::number(stats.retained) + '\n'
+               + "retained-bytes " + QByteArray::number(stats.retainedBytes) + '\n'
+               + "dropped " + QByteArray::number(stats.dropped) + '\n'
+               + "dropped-bytes " + QByteArray::number(stats.droppedBytes) + '\n';
     }
 
     void topHalfDeletion()
@@ -308,6 +398,7 @@ private:
         if (currentCommand) {
             currentCommand->canceled();
         }
+        stopWatcher();
         if (fd != ASSUAN_INVALID_FD) {
 #if defined(Q_OS_WIN32)
             CloseHandle(fd);
@@ -315,12 +406,13 @@ private:
             ::close(fd);
 #endif
         }
-        notifiers.clear();
         closed = true;
     }
 
     void bottomHalfDeletion()
     {
+        qCDebug(KLEOPATRA_LOG) << "AssuanServerConnection: statistics of" << (void *)q << ":"
+                               << dumpStats().replace('\n', "; ").constData();
         if (sessionId) {
             SessionDataHandler::instance()->exitSession(sessionId);
         }
@@ -453,6 +545,12 @@ private:
             ba = conn.dumpRecipients();
         } else if (qstrcmp(line, "x-files") == 0) {
             ba = conn.dumpFiles();
+        } else if (qstrcmp(line, "x-stats") == 0) {
+            ba = conn.dumpStats();
+        } else if (qstrcmp(line, "x-sessions") == 0) {
+            ba = dumpSessionStatistics();
+        } else if (qstrcmp(line, "x-auditlogs") == 0) {
+            ba = dumpAuditLogStatistics();
         } else {
             static const QString errorString = i18n("Unknown value for WHAT");
             return assuan_process_done_msg(ctx_, gpg_error(GPG_ERR_ASS_PARAMETER), errorString);
@@ -875,7 +973,17 @@ private:
     GpgME::Protocol bias;
     QString sessionTitle;
     unsigned int sessionId;
-    std::vector< std::shared_ptr<QSocketNotifier> > notifiers;
+    AssuanLineWatcher *watcher; // lives in the I/O thread
+    qint64 commandStartedAt;
+    struct Statistics {
+        qint64 lines = 0;
+        qint64 commands = 0;
+        qint64 totalQueueLatency = 0; // all times in microseconds
+        qint64 maxQueueLatency = 0;
+        qint64 totalProcessingTime = 0;
+        qint64 totalCommandTime = 0;
+        int maxQueueDepth = 0; // over all connections, as seen by our lines
+    } stats;
     std::vector< std::shared_ptr<AssuanCommandFactory> > factories; // sorted: _detail::ByName<std::less>
     std::shared_ptr<AssuanCommand> currentCommand;
     std::vector< std::shared_ptr<AssuanCommand> > nohupedCommands;
@@ -894,12 +1002,12 @@ void AssuanServerConnection::Private::cleanup()
     currentCommand.reset();
     currentCommandIsNohup = false;
     commandWaitingForCryptoCommandsEnabled = false;
-    notifiers.clear();
+    stopWatcher();
     ctx.reset();
     fd = ASSUAN_INVALID_FD;
 }
 
-AssuanServerConnection::Private::Private(assuan_fd_t fd_, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories_, AssuanServerConnection *qq)
+AssuanServerConnection::Private::Private(assuan_fd_t fd_, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories_, QThread *ioThread, AssuanServerConnection *qq)
     : QObject(),
       q(qq),
       fd(fd_),
@@ -911,7 +1019,9 @@ AssuanServerConnection::Private::Private(assuan_fd_t fd_, const std::vector< std
       informativeRecipients(false),
       bias(GpgME::UnknownProtocol),
       sessionId(0),
-      factories(factories_)
+      factories(factories_),
+      watcher(nullptr),
+      commandStartedAt(0)
 {
 #ifdef __GLIBCXX__
     Q_ASSERT(__gnu_cxx::is_sorted(factories_.begin(), factories_.end(), _detail::ByName<std::less>()));
@@ -946,23 +1056,12 @@ AssuanServerConnection::Private::Private(assuan_fd_t fd_, const std::vector< std
     FILE *const logFile = Log::instance()->logFile();
     assuan_set_log_stream(ctx.get(), logFile ? logFile : stderr);
 
-    // register FDs with the event loop:
+#ifndef NDEBUG
+    // a socket server only ever reads from the connection's socket:
     assuan_fd_t fds[MAX_ACTIVE_FDS];
     const int numFDs = assuan_get_active_fds(ctx.get(), FOR_READING, fds, MAX_ACTIVE_FDS);
-    Q_ASSERT(numFDs != -1);   // == 1
-
-    if (!numFDs || fds[0] != fd) {
-        const std::shared_ptr<QSocketNotifier> sn(new QSocketNotifier((intptr_t)fd, QSocketNotifier::Read), std::mem_fn(&QObject::deleteLater));
-        connect(sn.get(), &QSocketNotifier::activated, this, &Private::slotReadActivity);
-        notifiers.push_back(sn);
-    }
-
-    notifiers.reserve(notifiers.size() + numFDs);
-    for (int i = 0; i < numFDs; ++i) {
-        const std::shared_ptr<QSocketNotifier> sn(new QSocketNotifier((intptr_t)fds[i], QSocketNotifier::Read), std::mem_fn(&QObject::deleteLater));
-        connect(sn.get(), &QSocketNotifier::activated, this, &Private::slotReadActivity);
-        notifiers.push_back(sn);
-    }
+    Q_ASSERT(numFDs == 0 || (numFDs == 1 && fds[0] == fd));
+#endif
 
     // register our INPUT/OUTPUT/MESSGAE/FILE handlers:
 #ifndef HAVE_ASSUAN2
@@ -1059,6 +1158,15 @@ AssuanServerConnection::Private::Private(assuan_fd_t fd_, const std::vector< std
     if (const gpg_error_t err = assuan_accept(ctx.get())) {
         throw Exception(err, "assuan_accept");
     }
+
+    // wait for requests on the I/O thread; only complete lines are
+    // handed back to us:
+    watcher = new AssuanLineWatcher((intptr_t)fd);
+    if (ioThread) {
+        watcher->moveToThread(ioThread);
+    }
+    connect(watcher, &AssuanLineWatcher::lineAvailable, this, &Private::slotLineAvailable);
+    QMetaObject::invokeMethod(watcher, "rearm", Qt::QueuedConnection);
 }
 
 AssuanServerConnection::Private::~Private()
@@ -1066,8 +1174,8 @@ AssuanServerConnection::Private::~Private()
     cleanup();
 }
 
-AssuanServerConnection::AssuanServerConnection(assuan_fd_t fd, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories, QObject *p)
-    : QObject(p), d(new Private(fd, factories, this))
+AssuanServerConnection::AssuanServerConnection(assuan_fd_t fd, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories, QThread *ioThread, QObject *p)
+    : QObject(p), d(new Private(fd, factories, ioThread, this))
 {
 
 }
@@ -1567,6 +1675,7 @@ gpg_error_t AssuanCommandFactory::_handle(assuan_context_t ctx, char *line, cons
 
         conn.currentCommand = cmd;
         conn.currentCommandIsNohup = nohup;
+        conn.commandStartedAt = AssuanLineWatcher::now();
 
         QTimer::singleShot(0, &conn, &AssuanServerConnection::Private::startCommandBottomHalf);
 
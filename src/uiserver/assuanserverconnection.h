@@ -43,6 +43,8 @@
 #include <string>
 #include <vector>
 
+class QThread;
+
 namespace Kleo
 {
 
@@ -52,7 +54,11 @@ class AssuanServerConnection : public QObject
 {
     Q_OBJECT
 public:
-    AssuanServerConnection(assuan_fd_t fd, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories, QObject *parent = nullptr);
+    /**
+     * Serves the client connected to @p fd. The socket is watched from
+     * @p ioThread, if given; the commands are executed in the calling thread.
+     */
+    AssuanServerConnection(assuan_fd_t fd, const std::vector< std::shared_ptr<AssuanCommandFactory> > &factories, QThread *ioThread = nullptr, QObject *parent = nullptr);
     ~AssuanServerConnection();
 
 public Q_SLOTS:
@@ -35,6 +35,7 @@
 #include "decryptverifycommandemailbase.h"
 
 #include <crypto/decryptverifytask.h>
+#include <crypto/signerkeycache.h>
 #include <crypto/decryptverifyemailcontroller.h>
 
 #include <utils/hex.h>
@@ -224,7 +225,7 @@ void DecryptVerifyCommandEMailBase::Private::verificationResult(const Verificati
     try {
         const std::vector<Signature> sigs = vResult.signatures();
         Q_FOREACH (const Signature &sig, sigs) {
-            const QString s = signatureToString(sig, sig.key(true, true));
+            const QString s = signatureToString(sig, SignerKeyCache::instance()->findSigner(sig));
             const char *color = summaryToString(sig.summary());
             q->sendStatusEncoded("SIGSTATUS",
                                  color + (' ' + hexencode(s.toUtf8().constData())));
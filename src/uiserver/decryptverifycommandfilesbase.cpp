@@ -36,6 +36,7 @@
 #include "fileoperationspreferences.h"
 
 #include <crypto/decryptverifytask.h>
+#include <crypto/signerkeycache.h>
 
 #include "crypto/decryptverifyfilescontroller.h"
 #include "crypto/autodecryptverifyfilescontroller.h"
@@ -205,7 +206,7 @@ void DecryptVerifyCommandFilesBase::Private::verificationResult(const Verificati
     try {
         const std::vector<Signature> sigs = vResult.signatures();
         for (const Signature &sig : sigs) {
-            const QString s = signatureToString(sig, sig.key(true, true));
+            const QString s = signatureToString(sig, SignerKeyCache::instance()->findSigner(sig));
             const char *color = summaryToString(sig.summary());
             q->sendStatusEncoded("SIGSTATUS",
                                  color + (' ' + hexencode(s.toUtf8().constData())));
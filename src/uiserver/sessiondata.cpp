@@ -36,100 +36,164 @@
 
 #include "kleopatra_debug.h"
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QMutex>
+#include <QMutexLocker>
 
+#include <unordered_map>
 
 using namespace Kleo;
 
-static const int GARBAGE_COLLECTION_INTERVAL = 60000; // 1min
+static const int NUM_SHARDS = 16;
+static const qint64 GENERATION_LENGTH = 60000; // 1min
+// an idle session expires at the second generation change, i.e.
+// after one to two minutes, as with the former garbage collection
+static const int EXPIRY_GENERATIONS = 2;
 
-static QMutex mutex;
+static int currentGeneration()
+{
+    static QElapsedTimer timer;
+    static const bool started = (timer.start(), true);
+    Q_UNUSED(started);
+    return timer.elapsed() / GENERATION_LENGTH;
+}
 
 SessionData::SessionData()
     : mementos(),
       ref(0),
-      ripe(false)
+      idleSince(0)
 {
 
 }
 
+class SessionDataHandler::Private
+{
+public:
+    struct Shard {
+        Shard() : sweptGeneration(0) {}
+        QMutex mutex;
+        std::unordered_map< unsigned int, std::shared_ptr<SessionData> > data;
+        int sweptGeneration;
+    };
+
+    Shard &shard(unsigned int id)
+    {
+        return shards[id % NUM_SHARDS];
+    }
+
+    static bool isExpired(const SessionData &sd, int generation)
+    {
+        return sd.ref == 0 && generation - sd.idleSince >= EXPIRY_GENERATIONS;
+    }
+
+    // all of the following expect the shard to be locked:
+
+    void sweep(Shard &s, int generation)
+    {
+        if (s.sweptGeneration == generation) {
+            return;
+        }
+        s.sweptGeneration = generation;
+        for (auto it = s.data.begin(); it != s.data.end();) {
+            if (isExpired(*it->second, generation)) {
+                it = s.data.erase(it);
+                stored.deref();
+                expired.ref();
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    const std::shared_ptr<SessionData> &lookup(Shard &s, unsigned int id)
+    {
+        const int generation = currentGeneration();
+        sweep(s, generation);
+        std::shared_ptr<SessionData> &sd = s.data[id];
+        if (!sd) {
+            sd.reset(new SessionData);
+            sd->idleSince = generation;
+            stored.ref();
+            created.ref();
+        }
+        return sd;
+    }
+
+    Shard shards[NUM_SHARDS];
+    QAtomicInt active, stored, created, expired;
+};
+
 // static
 std::shared_ptr<SessionDataHandler> SessionDataHandler::instance()
 {
-    mutex.lock();
     static SessionDataHandler handler;
-    return std::shared_ptr<SessionDataHandler>(&handler, [](SessionDataHandler*) { mutex.unlock(); });
+    return std::shared_ptr<SessionDataHandler>(&handler, [](SessionDataHandler *) {});
 }
 
 SessionDataHandler::SessionDataHandler()
-    : QObject(),
-      data(),
-      timer()
+    : d(new Private)
 {
-    timer.setInterval(GARBAGE_COLLECTION_INTERVAL);
-    timer.setSingleShot(false);
 }
 
-void SessionDataHandler::enterSession(unsigned int id)
+SessionDataHandler::~SessionDataHandler()
 {
-    qCDebug(KLEOPATRA_LOG) << id;
-    const std::shared_ptr<SessionData> sd = sessionDataInternal(id);
-    Q_ASSERT(sd);
-    ++sd->ref;
-    sd->ripe = false;
 }
 
-void SessionDataHandler::exitSession(unsigned int id)
+void SessionDataHandler::enterSession(unsigned int id)
 {
     qCDebug(KLEOPATRA_LOG) << id;
-    const std::shared_ptr<SessionData> sd = sessionDataInternal(id);
+    Private::Shard &shard = d->shard(id);
+    const QMutexLocker locker(&shard.mutex);
+    const std::shared_ptr<SessionData> &sd = d->lookup(shard, id);
     Q_ASSERT(sd);
-    if (--sd->ref <= 0) {
-        sd->ref = 0;
-        sd->ripe = false;
-        if (!timer.isActive()) {
-            QMetaObject::invokeMethod(&timer, "start", Qt::QueuedConnection);
-        }
+    if (sd->ref++ == 0) {
+        d->active.ref();
     }
 }
 
-std::shared_ptr<SessionData> SessionDataHandler::sessionDataInternal(unsigned int id) const
+void SessionDataHandler::exitSession(unsigned int id)
 {
-    std::map< unsigned int, std::shared_ptr<SessionData> >::iterator
-    it = data.lower_bound(id);
-    if (it == data.end() || it->first != id) {
-        const std::shared_ptr<SessionData> sd(new SessionData);
-        it = data.insert(it, std::make_pair(id, sd));
+    qCDebug(KLEOPATRA_LOG) << id;
+    Private::Shard &shard = d->shard(id);
+    const QMutexLocker locker(&shard.mutex);
+    const std::shared_ptr<SessionData> &sd = d->lookup(shard, id);
+    Q_ASSERT(sd);
+    if (sd->ref > 0 && --sd->ref == 0) {
+        sd->idleSince = currentGeneration();
+        d->active.deref();
     }
-    return it->second;
 }
 
 std::shared_ptr<SessionData> SessionDataHandler::sessionData(unsigned int id) const
 {
-    return sessionDataInternal(id);
+    Private::Shard &shard = d->shard(id);
+    shard.mutex.lock();
+    const std::shared_ptr<SessionData> sd = d->lookup(shard, id);
+    return std::shared_ptr<SessionData>(sd.get(), [sd, &shard](SessionData *) { shard.mutex.unlock(); });
 }
 
 void SessionDataHandler::clear()
 {
-    data.clear();
+    for (Private::Shard &shard : d->shards) {
+        const QMutexLocker locker(&shard.mutex);
+        for (const auto &entry : shard.data) {
+            if (entry.second->ref) {
+                d->active.deref();
+            }
+        }
+        d->stored.fetchAndAddOrdered(-static_cast<int>(shard.data.size()));
+        shard.data.clear();
+    }
 }
 
-void SessionDataHandler::slotCollectGarbage()
+SessionDataHandler::Statistics SessionDataHandler::statistics() const
 {
-    const QMutexLocker locker(&mutex);
-    unsigned int alive = 0;
-    std::map< unsigned int, std::shared_ptr<SessionData> >::iterator it = data.begin(), end = data.end();
-    while (it != end)
-        if (it->second->ripe) {
-            data.erase(it++);
-        } else if (!it->second->ref) {
-            it->second->ripe = true;
-            ++it;
-        } else {
-            ++alive;
-            ++it;
-        }
-    if (alive == data.size()) {
-        QMetaObject::invokeMethod(&timer, "stop", Qt::QueuedConnection);
-    }
+    const Statistics stats = {
+        static_cast<unsigned int>(d->active.load()),
+        static_cast<unsigned int>(d->stored.load()),
+        static_cast<unsigned int>(d->created.load()),
+        static_cast<unsigned int>(d->expired.load()),
+    };
+    return stats;
 }
@@ -33,11 +33,9 @@
 #ifndef __KLEOPATRA_UISERVER_SESSIONDATA_H__
 #define __KLEOPATRA_UISERVER_SESSIONDATA_H__
 
-#include <QObject>
-
 #include "assuancommand.h"
 
-#include <QTimer>
+#include <utils/pimpl_ptr.h>
 
 #include <memory>
 #include <map>
@@ -57,32 +55,49 @@ private:
     friend class ::Kleo::SessionDataHandler;
     SessionData();
     int ref;
-    bool ripe;
+    int idleSince; // generation in which ref dropped to zero
 };
 
-class SessionDataHandler : public QObject
+/**
+ * Keeps the data of the sessions, which may span several connections.
+ *
+ * The sessions are distributed over a number of independently locked
+ * shards. A session that is no longer referenced expires after it
+ * has been idle for a while; expired sessions are dropped the next
+ * time their shard is used, so no timer is needed.
+ */
+class SessionDataHandler
 {
 public:
 
+    struct Statistics {
+        unsigned int active;  // sessions entered by at least one connection
+        unsigned int stored;  // all sessions kept, active or idle
+        unsigned int created;
+        unsigned int expired;
+    };
+
     static std::shared_ptr<SessionDataHandler> instance();
 
     void enterSession(unsigned int id);
     void exitSession(unsigned int id);
 
-    std::shared_ptr<SessionData> sessionData(unsigned int) const;
+    /**
+     * Returns the data of session @p id, creating it if needed. The
+     * session's shard stays locked until the returned pointer is
+     * released, so do not keep it around.
+     */
+    std::shared_ptr<SessionData> sessionData(unsigned int id) const;
 
     void clear();
 
-private Q_SLOTS:
-    void slotCollectGarbage();
-
-private:
-    mutable std::map< unsigned int, std::shared_ptr<SessionData> > data;
-    QTimer timer;
+    Statistics statistics() const;
 
 private:
-    std::shared_ptr<SessionData> sessionDataInternal(unsigned int) const;
+    class Private;
     SessionDataHandler();
+    ~SessionDataHandler();
+    kdtools::pimpl_ptr<Private> d;
 };
 
 }
@@ -67,6 +67,7 @@ UiServer::Private::Private(UiServer *qq)
     : QTcpServer(),
       q(qq),
       file(),
+      ioThread(),
       factories(),
       connections(),
       suggestedSocketName(),
@@ -79,6 +80,16 @@ UiServer::Private::Private(UiServer *qq)
     assuan_set_gpg_err_source(GPG_ERR_SOURCE_DEFAULT);
     assuan_sock_init();
 #endif
+    ioThread.setObjectName(QStringLiteral("UiServer I/O"));
+    ioThread.start();
+}
+
+UiServer::Private::~Private()
+{
+    // the connections need the I/O thread to shut down
+    connections.clear();
+    ioThread.quit();
+    ioThread.wait();
 }
 
 bool UiServer::Private::isStaleAssuanSocket(const QString &fileName)
@@ -224,7 +235,7 @@ void UiServer::Private::incomingConnection(qintptr fd)
             return;
         }
 #endif
-        const std::shared_ptr<AssuanServerConnection> c(new AssuanServerConnection((assuan_fd_t)fd, factories));
+        const std::shared_ptr<AssuanServerConnection> c(new AssuanServerConnection((assuan_fd_t)fd, factories, &ioThread));
         connect(c.get(), &AssuanServerConnection::closed,
                 this, &Private::slotConnectionClosed);
         connect(c.get(), &AssuanServerConnection::startKeyManagerRequested,
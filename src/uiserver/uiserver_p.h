@@ -41,6 +41,7 @@
 
 #include <QTcpServer>
 #include <QFile>
+#include <QThread>
 
 #include <kleo-assuan.h>
 
@@ -67,6 +68,7 @@ class UiServer::Private : public QTcpServer
     UiServer *const q;
 public:
     explicit Private(UiServer *qq);
+    ~Private();
     static bool isStaleAssuanSocket(const QString &socketName);
 
 private:
@@ -85,6 +87,7 @@ private Q_SLOTS:
 
 private:
     QFile file;
+    QThread ioThread; // watches the sockets of all connections
     std::vector< std::shared_ptr<AssuanCommandFactory> > factories;
     std::vector< std::shared_ptr<AssuanServerConnection> > connections;
     QString suggestedSocketName;
@@ -376,6 +376,34 @@ std::shared_ptr<Input> ArchiveDefinition::createInputFromPackCommand(GpgME::Prot
     return std::shared_ptr<Input>(); // make compiler happy
 }
 
+std::vector< std::shared_ptr<Input> > ArchiveDefinition::createInputsFromPackCommand(const std::vector<Protocol> &protocols, const QStringList &files) const
+{
+    std::vector< std::shared_ptr<Input> > result(protocols.size());
+    for (unsigned int i = 0; i < protocols.size(); ++i) {
+        if (result[i]) {
+            continue;
+        }
+        const Protocol p = protocols[i];
+        checkProtocol(p);
+        std::vector<unsigned int> sharing;
+        for (unsigned int j = i; j < protocols.size(); ++j) {
+            const Protocol other = protocols[j];
+            checkProtocol(other);
+            if (other == p ||
+                    (m_packCommandMethod[other] == m_packCommandMethod[p] &&
+                     doGetPackCommand(other) == doGetPackCommand(p) &&
+                     doGetPackArguments(other, files) == doGetPackArguments(p, files))) {
+                sharing.push_back(j);
+            }
+        }
+        const std::vector< std::shared_ptr<Input> > inputs = Input::createTee(createInputFromPackCommand(p, files), sharing.size());
+        for (unsigned int k = 0; k < sharing.size(); ++k) {
+            result[sharing[k]] = inputs[k];
+        }
+    }
+    return result;
+}
+
 std::shared_ptr<Output> ArchiveDefinition::createOutputFromUnpackCommand(GpgME::Protocol p, const QString &file, const QDir &wd) const
 {
     checkProtocol(p);
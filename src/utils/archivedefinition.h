@@ -84,6 +84,8 @@ public:
     }
 
     std::shared_ptr<Input> createInputFromPackCommand(GpgME::Protocol p, const QStringList &files) const;
+    // one input per protocol; protocols with the same pack command share a single pack process
+    std::vector< std::shared_ptr<Input> > createInputsFromPackCommand(const std::vector<GpgME::Protocol> &protocols, const QStringList &files) const;
     ArgumentPassingMethod packCommandArgumentPassingMethod(GpgME::Protocol p) const
     {
         checkProtocol(p);
@@ -36,13 +36,171 @@
 
 #include <QGpgME/Job>
 
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QUrl>
-#include <QUrlQuery>
 #include "kleopatra_debug.h"
 #include <KLocalizedString>
 
+#include <deque>
+#include <memory>
+
 using namespace Kleo;
 
+namespace
+{
+// Most audit logs are never looked at, so only the latest ones are kept
+// (plus those kept for a result, see AuditLog::keepWhile())
+static const int MaxRetainedLogs = 256;
+static const int MaxRetainedBytes = 8 * 1024 * 1024;
+
+class AuditLogStore
+{
+public:
+    AuditLogStore() : m_nextId(1), m_bytes(0), m_insertsSincePrune(0), m_stats() {}
+
+    quint64 insert(const QString &text)
+    {
+        const QMutexLocker locker(&m_mutex);
+        const quint64 id = m_nextId++;
+        m_logs.insert(id, text);
+        m_order.push_back(id);
+        m_bytes += bytes(text);
+        ++m_stats.retained;
+        m_stats.retainedBytes += bytes(text);
+        // oldest first, but never the one just added
+        while (m_order.front() != id && (m_logs.size() > MaxRetainedLogs || m_bytes > MaxRetainedBytes)) {
+            const auto it = m_logs.find(m_order.front());
+            m_order.pop_front();
+            if (it == m_logs.end()) {
+                continue; // moved to m_kept
+            }
+            drop(*it);
+            m_logs.erase(it);
+        }
+        // checking m_kept once per m_kept.size() inserts keeps this O(1)
+        // on average
+        if (++m_insertsSincePrune >= static_cast<quint64>(m_kept.size())) {
+            pruneKept();
+        }
+        return id;
+    }
+
+    void keepWhile(quint64 id, const std::shared_ptr<const void> &owner)
+    {
+        const QMutexLocker locker(&m_mutex);
+        const auto kept = m_kept.find(id);
+        if (kept != m_kept.end()) {
+            kept->owner = owner;
+            return;
+        }
+        const auto it = m_logs.find(id);
+        if (it == m_logs.end()) {
+            return;
+        }
+        // its id stays in m_order and is skipped when it comes up
+        const KeptLog log = { *it, owner };
+        m_bytes -= bytes(*it);
+        m_logs.erase(it);
+        m_kept.insert(id, log);
+    }
+
+    QString text(quint64 id, bool *found) const
+    {
+        const QMutexLocker locker(&m_mutex);
+        const auto it = m_logs.constFind(id);
+        if (it != m_logs.constEnd()) {
+            *found = true;
+            return *it;
+        }
+        const auto kept = m_kept.constFind(id);
+        *found = kept != m_kept.constEnd();
+        return *found ? kept->text : QString();
+    }
+
+    AuditLog::Statistics statistics() const
+    {
+        const QMutexLocker locker(&m_mutex);
+        return m_stats;
+    }
+
+private:
+    static quint64 bytes(const QString &text)
+    {
+        return text.size() * sizeof(QChar);
+    }
+
+    void drop(const QString &text)
+    {
+        ++m_stats.dropped;
+        m_stats.droppedBytes += bytes(text);
+    }
+
+    // drops the kept logs whose owner is gone
+    void pruneKept()
+    {
+        m_insertsSincePrune = 0;
+        for (auto it = m_kept.begin(); it != m_kept.end();) {
+            if (it->owner.expired()) {
+                drop(it->text);
+                it = m_kept.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    struct KeptLog {
+        QString text;
+        std::weak_ptr<const void> owner;
+    };
+
+    mutable QMutex m_mutex;
+    // the logs that may be dropped, and their ids, oldest first
+    QHash<quint64, QString> m_logs;
+    std::deque<quint64> m_order;
+    quint64 m_nextId;
+    quint64 m_bytes; // of m_logs
+    // logs that are not dropped while their owner lives, see keepWhile()
+    QHash<quint64, KeptLog> m_kept;
+    quint64 m_insertsSincePrune;
+    AuditLog::Statistics m_stats;
+};
+}
+
+Q_GLOBAL_STATIC(AuditLogStore, store)
+
+AuditLog::AuditLog(const QString &text, const GpgME::Error &error)
+    : m_id(text.isEmpty() ? 0 : store()->insert(text)), m_error(error)
+{
+}
+
+QString AuditLog::text() const
+{
+    if (!m_id) {
+        return QString();
+    }
+    bool found = false;
+    const QString text = store()->text(m_id, &found);
+    if (!found) {
+        return i18n("<p>This audit log is no longer available. Only the audit logs of the most recent operations are kept.</p>");
+    }
+    return text;
+}
+
+void AuditLog::keepWhile(const std::shared_ptr<const void> &owner) const
+{
+    if (m_id && owner) {
+        store()->keepWhile(m_id, owner);
+    }
+}
+
+AuditLog::Statistics AuditLog::statistics()
+{
+    return store()->statistics();
+}
+
 AuditLog AuditLog::fromJob(const QGpgME::Job *job)
 {
     if (job) {
@@ -68,12 +226,10 @@ QString AuditLog::formatLink(const QUrl &urlTemplate) const
         return QString();
     }
 
-    if (!m_text.isEmpty()) {
-        QUrl url = urlTemplate;
-        QUrlQuery urlQuery(url);
-        urlQuery.addQueryItem(QStringLiteral("log"), m_text);
-        url.setQuery(urlQuery);
-        return QLatin1String("<a href=\"") + url.url() + QLatin1String("\">") + i18nc("The Audit Log is a detailed error log from the gnupg backend", "Show Audit Log") + QLatin1String("</a>");
+    // The link does not carry the log; whoever handles it asks the
+    // result for its audit log.
+    if (m_id) {
+        return QLatin1String("<a href=\"") + urlTemplate.url() + QLatin1String("\">") + i18nc("The Audit Log is a detailed error log from the gnupg backend", "Show Audit Log") + QLatin1String("</a>");
     }
 
     return QString();
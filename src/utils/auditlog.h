@@ -37,6 +37,8 @@
 #include <gpgme++/error.h>
 #include <gpg-error.h>
 
+#include <memory>
+
 class QUrl;
 
 namespace QGpgME
@@ -47,14 +49,17 @@ class Job;
 namespace Kleo
 {
 
+/* The audit log of a finished job. Only the most recent logs are kept
+ * in memory; an AuditLog is a small handle to its text, which may have
+ * been dropped by the time it is asked for, unless keepWhile() was
+ * called for it. */
 class AuditLog
 {
 public:
-    AuditLog() : m_text(), m_error() {}
+    AuditLog() : m_id(0), m_error() {}
     explicit AuditLog(const GpgME::Error &error)
-        : m_text(), m_error(error) {}
-    AuditLog(const QString &text, const GpgME::Error &error)
-        : m_text(text), m_error(error) {}
+        : m_id(0), m_error(error) {}
+    AuditLog(const QString &text, const GpgME::Error &error);
 
     static AuditLog fromJob(const QGpgME::Job *);
 
@@ -62,15 +67,23 @@ public:
     {
         return m_error;
     }
-    QString text() const
-    {
-        return m_text;
-    }
+    QString text() const;
 
     QString formatLink(const QUrl &urlTemplate) const;
 
+    /* Keeps the text from being dropped for as long as owner lives */
+    void keepWhile(const std::shared_ptr<const void> &owner) const;
+
+    struct Statistics {
+        quint64 retained;
+        quint64 retainedBytes;
+        quint64 dropped;
+        quint64 droppedBytes;
+    };
+    static Statistics statistics();
+
 private:
-    QString m_text;
+    quint64 m_id;
     GpgME::Error m_error;
 };
 
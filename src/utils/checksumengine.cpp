@@ -0,0 +1,262 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/checksumengine.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "checksumengine.h"
+
+#include <Libkleo/ChecksumDefinition>
+
+#include "kleopatra_debug.h"
+#include <KLocalizedString>
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+
+#ifdef HAVE_POSIX_MADVISE
+# include <sys/mman.h>
+#endif
+
+#include <algorithm>
+
+using namespace Kleo;
+
+// Must be a multiple of the page size, so every window we map starts
+// page-aligned (required for posix_madvise).
+static const qint64 MAP_WINDOW_SIZE = 64 * 1024 * 1024;
+static const qint64 READ_CHUNK_SIZE = 1024 * 1024;
+
+static const struct {
+    const char *program;
+    QCryptographicHash::Algorithm algorithm;
+} knownPrograms[] = {
+    { "md5sum",    QCryptographicHash::Md5    },
+    { "sha1sum",   QCryptographicHash::Sha1   },
+    { "sha224sum", QCryptographicHash::Sha224 },
+    { "sha256sum", QCryptographicHash::Sha256 },
+    { "sha384sum", QCryptographicHash::Sha384 },
+    { "sha512sum", QCryptographicHash::Sha512 },
+};
+static const size_t numKnownPrograms = sizeof knownPrograms / sizeof * knownPrograms;
+
+// The options of the default definitions, i.e. those that do not change
+// what the program outputs. Anything else is left to the real program.
+static bool hasDefaultArguments(const QStringList &arguments, const QString &file, bool verify)
+{
+    bool check = false;
+    for (const QString &arg : arguments) {
+        if (arg == file || arg == QLatin1String("--")) {
+            continue;
+        }
+        if (verify && (arg == QLatin1String("-c") || arg == QLatin1String("--check"))) {
+            check = true;
+            continue;
+        }
+        return false;
+    }
+    return !verify || check;
+}
+
+static bool program2algorithm(const QString &command, QCryptographicHash::Algorithm *algo)
+{
+    if (command.isEmpty()) {
+        return false;
+    }
+    // baseName() also strips a Windows ".exe"
+    const QString program = QFileInfo(command).baseName();
+    for (unsigned int i = 0; i < numKnownPrograms; ++i)
+        if (program == QLatin1String(knownPrograms[i].program)) {
+            *algo = knownPrograms[i].algorithm;
+            return true;
+        }
+    return false;
+}
+
+ChecksumEngine::ChecksumEngine(const std::shared_ptr<ChecksumDefinition> &cd)
+    : m_algorithm(QCryptographicHash::Sha256),
+      m_canCreate(false),
+      m_canVerify(false)
+{
+    if (!cd) {
+        return;
+    }
+    const QString file = QStringLiteral("FILE");
+    QCryptographicHash::Algorithm createAlgo, verifyAlgo;
+    const bool create = program2algorithm(cd->createCommand(), &createAlgo)
+                        && hasDefaultArguments(cd->createCommandArguments(QStringList(file)), file, false);
+    const bool verify = program2algorithm(cd->verifyCommand(), &verifyAlgo)
+                        && hasDefaultArguments(cd->verifyCommandArguments(QStringList(file)), file, true);
+    if (create) {
+        m_algorithm = createAlgo;
+    } else if (verify) {
+        m_algorithm = verifyAlgo;
+    }
+    // refuse definitions that create with one algorithm and verify with another:
+    m_canCreate = create && (!verify || createAlgo == verifyAlgo);
+    m_canVerify = verify && (!create || createAlgo == verifyAlgo);
+    qCDebug(KLEOPATRA_LOG) << "checksum definition" << cd->id()
+                           << "built-in create:" << m_canCreate << "built-in verify:" << m_canVerify;
+}
+
+static void advise_sequential(uchar *data, qint64 length)
+{
+#ifdef HAVE_POSIX_MADVISE
+    (void)posix_madvise(data, length, POSIX_MADV_SEQUENTIAL);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(length);
+#endif
+}
+
+QByteArray ChecksumEngine::checksum(const QString &fileName, QString *errorString,
+                                    const std::function<void(quint64)> &progress,
+                                    const volatile bool *canceled) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) {
+            *errorString = i18n("Cannot open %1: %2", fileName, file.errorString());
+        }
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(m_algorithm);
+
+    const qint64 size = file.isSequential() ? 0 : file.size();
+    qint64 offset = 0;
+
+    while (offset < size) {
+        if (canceled && *canceled) {
+            return QByteArray();
+        }
+        const qint64 length = std::min(MAP_WINDOW_SIZE, size - offset);
+        uchar *const data = file.map(offset, length);
+        if (!data) {
+            break; // continue below with read()
+        }
+        advise_sequential(data, length);
+        hash.addData(reinterpret_cast<const char *>(data), static_cast<int>(length));
+        file.unmap(data);
+        offset += length;
+        if (progress) {
+            progress(length);
+        }
+    }
+
+    if (offset < size || size == 0) {
+        // not mappable, or size unknown (pipes, special files):
+        if (offset && !file.seek(offset)) {
+            if (errorString) {
+                *errorString = i18n("Error while reading %1: %2", fileName, file.errorString());
+            }
+            return QByteArray();
+        }
+        QByteArray buffer(READ_CHUNK_SIZE, Qt::Uninitialized);
+        while (true) {
+            if (canceled && *canceled) {
+                return QByteArray();
+            }
+            const qint64 read = file.read(buffer.data(), buffer.size());
+            if (read < 0) {
+                if (errorString) {
+                    *errorString = i18n("Error while reading %1: %2", fileName, file.errorString());
+                }
+                return QByteArray();
+            }
+            if (read == 0) {
+                break;
+            }
+            hash.addData(buffer.constData(), static_cast<int>(read));
+            if (progress) {
+                progress(read);
+            }
+        }
+    }
+
+    return hash.result().toHex();
+}
+
+QByteArray ChecksumEngine::formatLine(const QString &fileName, const QByteArray &checksum, bool binary)
+{
+    QByteArray name = QFile::encodeName(fileName);
+    // GNU coreutils escape '\\' and '\n' in file names and flag
+    // such lines with a leading backslash:
+    const bool escape = name.contains('\\') || name.contains('\n');
+    if (escape) {
+        name.replace('\\', "\\\\");
+        name.replace('\n', "\\n");
+    }
+    QByteArray line;
+    line.reserve(checksum.size() + name.size() + 4);
+    if (escape) {
+        line += '\\';
+    }
+    line += checksum;
+    line += ' ';
+    line += binary ? '*' : ' ';
+    line += name;
+    line += '\n';
+    return line;
+}
+
+bool ChecksumEngine::writeSumFile(const QString &sumFileName,
+                                  const std::vector< std::pair<QString, QByteArray> > &entries,
+                                  QString *errorString)
+{
+    QSaveFile file(sumFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+    for (const std::pair<QString, QByteArray> &entry : entries) {
+        const QByteArray line = formatLine(entry.first, entry.second);
+        if (file.write(line) != line.size()) {
+            if (errorString) {
+                *errorString = file.errorString();
+            }
+            file.cancelWriting();
+            return false;
+        }
+    }
+    if (!file.commit()) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/checksumengine.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_UTILS_CHECKSUMENGINE_H__
+#define __KLEOPATRA_UTILS_CHECKSUMENGINE_H__
+
+#include <QCryptographicHash>
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class QByteArray;
+
+namespace Kleo
+{
+class ChecksumDefinition;
+}
+
+namespace Kleo
+{
+
+/**
+ * Computes checksums in-process for those ChecksumDefinitions whose
+ * create/verify commands are one of the GNU coreutils *sum programs
+ * (md5sum, sha1sum, sha224sum, sha256sum, sha384sum, sha512sum), called
+ * with no options besides the defaults ("-c" to verify, "--"). Definitions
+ * with other options keep using the external program.
+ *
+ * Files are read through windows of a read-only memory mapping, falling
+ * back to large sequential reads for files that cannot be mapped (pipes,
+ * special files). The sum files written are byte-for-byte what the
+ * corresponding coreutils program would have produced.
+ */
+class ChecksumEngine
+{
+public:
+    explicit ChecksumEngine(const std::shared_ptr<ChecksumDefinition> &cd);
+
+    /** Whether the definition's create-command can be replaced by us. */
+    bool canCreate() const
+    {
+        return m_canCreate;
+    }
+    /** Whether the definition's verify-command can be replaced by us. */
+    bool canVerify() const
+    {
+        return m_canVerify;
+    }
+
+    QCryptographicHash::Algorithm algorithm() const
+    {
+        return m_algorithm;
+    }
+
+    /**
+     * Returns the lower-case hex checksum of @p fileName, or a null
+     * QByteArray on error (with @p errorString set) or cancellation.
+     * @p progress, if set, is called with the number of bytes consumed
+     * since the last call.
+     */
+    QByteArray checksum(const QString &fileName, QString *errorString,
+                        const std::function<void(quint64)> &progress = std::function<void(quint64)>(),
+                        const volatile bool *canceled = nullptr) const;
+
+    /** One line of a GNU-format sum file, including the terminating newline. */
+    static QByteArray formatLine(const QString &fileName, const QByteArray &checksum, bool binary = false);
+
+    /** Atomically (re)writes @p sumFileName from (file name, hex checksum) pairs. */
+    static bool writeSumFile(const QString &sumFileName,
+                             const std::vector< std::pair<QString, QByteArray> > &entries,
+                             QString *errorString);
+
+private:
+    QCryptographicHash::Algorithm m_algorithm;
+    bool m_canCreate;
+    bool m_canVerify;
+};
+
+}
+
+#endif /* __KLEOPATRA_UTILS_CHECKSUMENGINE_H__ */
@@ -0,0 +1,223 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/checksumscanner.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "checksumscanner.h"
+
+#include "parallel.h"
+
+#include <Libkleo/ChecksumDefinition>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <dirent.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+using namespace Kleo;
+
+#ifdef Q_OS_UNIX
+static const Qt::CaseSensitivity fs_cs = Qt::CaseSensitive;
+#else
+static const Qt::CaseSensitivity fs_cs = Qt::CaseInsensitive;
+#endif
+
+static void sortLikeQDir(QStringList &names)
+{
+    std::sort(names.begin(), names.end(), [](const QString &lhs, const QString &rhs) {
+        const int rc = QString::compare(lhs, rhs, Qt::CaseInsensitive);
+        return rc < 0 || (rc == 0 && lhs < rhs);
+    });
+}
+
+static DirectoryListing readDirectory(const QString &path)
+{
+    DirectoryListing listing;
+    listing.path = QDir(path).absolutePath();
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(listing.path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return listing;
+    }
+    DIR *const dir = ::fdopendir(fd);
+    if (!dir) {
+        ::close(fd);
+        return listing;
+    }
+    while (const struct dirent *const entry = ::readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            // hidden, ".", ".."
+            continue;
+        }
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type == DT_DIR) {
+            listing.subdirs.push_back(QFile::decodeName(entry->d_name));
+            continue;
+        }
+#endif
+        struct stat st;
+        if (::fstatat(fd, entry->d_name, &st, 0) != 0) {
+            continue; // e.g. a dangling symlink
+        }
+        if (S_ISREG(st.st_mode)) {
+            const QString name = QFile::decodeName(entry->d_name);
+            listing.files.push_back(name);
+            listing.sizes.insert(name, st.st_size);
+        } else if (S_ISDIR(st.st_mode)) {
+            listing.subdirs.push_back(QFile::decodeName(entry->d_name));
+        }
+    }
+    ::closedir(dir); // closes fd, too
+#else
+    if (!QFileInfo(listing.path).isDir()) {
+        return listing;
+    }
+    // the directory iterator gets type and size along with the names
+    QDirIterator it(listing.path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo fi = it.fileInfo();
+        if (fi.isDir()) {
+            listing.subdirs.push_back(fi.fileName());
+        } else {
+            listing.files.push_back(fi.fileName());
+            listing.sizes.insert(fi.fileName(), fi.size());
+        }
+    }
+#endif
+    sortLikeQDir(listing.files);
+    sortLikeQDir(listing.subdirs);
+    listing.ok = true;
+    return listing;
+}
+
+quint64 DirectoryListing::size(const QString &fileName) const
+{
+    const auto it = sizes.constFind(fileName);
+    if (it != sizes.cend()) {
+        return *it;
+    }
+    return QFileInfo(QDir(path).absoluteFilePath(fileName)).size();
+}
+
+quint64 DirectoryListing::totalSize(const QStringList &fileNames) const
+{
+    quint64 n = 0;
+    for (const QString &fileName : fileNames) {
+        n += size(fileName);
+    }
+    return n;
+}
+
+std::vector<DirectoryListing> Kleo::scanDirectories(const QStringList &dirs, bool recursive,
+                                                    const std::function<void(int)> &progress)
+{
+    std::vector<DirectoryListing> result;
+    std::vector<QString> level(dirs.cbegin(), dirs.cend());
+    while (!level.empty()) {
+        std::vector<DirectoryListing> listings(level.size());
+        parallelFor(static_cast<int>(level.size()), [&level, &listings](int idx) {
+            listings[idx] = readDirectory(level[idx]);
+        });
+
+        std::vector<QString> next;
+        for (DirectoryListing &listing : listings) {
+            if (recursive) {
+                const QDir dir(listing.path);
+                for (const QString &subdir : listing.subdirs) {
+                    next.push_back(dir.absoluteFilePath(subdir));
+                }
+            }
+            result.push_back(std::move(listing));
+        }
+        if (progress) {
+            progress(static_cast<int>(result.size()));
+        }
+        level.swap(next);
+    }
+    return result;
+}
+
+ChecksumFilePatterns::ChecksumFilePatterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+{
+    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions) {
+        if (cd) {
+            Q_FOREACH (const QString &pattern, cd->patterns()) {
+                m_patterns.push_back(std::make_pair(QRegExp(pattern, fs_cs), cd));
+            }
+        }
+    }
+}
+
+bool ChecksumFilePatterns::matches(const QString &fileName) const
+{
+    return std::any_of(m_patterns.cbegin(), m_patterns.cend(),
+                       [&fileName](const std::pair<QRegExp, std::shared_ptr<ChecksumDefinition> > &p) {
+                           return p.first.exactMatch(fileName);
+                       });
+}
+
+std::shared_ptr<ChecksumDefinition> ChecksumFilePatterns::definition(const QString &fileName) const
+{
+    for (const auto &p : m_patterns) {
+        if (p.first.exactMatch(fileName)) {
+            return p.second;
+        }
+    }
+    return std::shared_ptr<ChecksumDefinition>();
+}
+
+QStringList ChecksumFilePatterns::sumFiles(const QStringList &fileNames) const
+{
+    QStringList result;
+    std::copy_if(fileNames.cbegin(), fileNames.cend(), std::back_inserter(result),
+                 [this](const QString &fileName) { return matches(fileName); });
+    return result;
+}
+
+QStringList ChecksumFilePatterns::withoutSumFiles(const QStringList &fileNames) const
+{
+    QStringList result;
+    std::copy_if(fileNames.cbegin(), fileNames.cend(), std::back_inserter(result),
+                 [this](const QString &fileName) { return !matches(fileName); });
+    return result;
+}
@@ -0,0 +1,106 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/checksumscanner.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_UTILS_CHECKSUMSCANNER_H__
+#define __KLEOPATRA_UTILS_CHECKSUMSCANNER_H__
+
+#include <QHash>
+#include <QRegExp>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Kleo
+{
+class ChecksumDefinition;
+
+/**
+ * The contents of one directory as read by scanDirectories().
+ *
+ * Like QDir::entryList() with its default filter, hidden entries are
+ * skipped and symbolic links are followed. Names are sorted the way
+ * QDir sorts them by default.
+ */
+struct DirectoryListing {
+    QString path; // absolute
+    QStringList files;
+    QStringList subdirs;
+    QHash<QString, quint64> sizes; // of the files
+    bool ok = false;
+
+    /** The size of @p fileName (relative to path or absolute). */
+    quint64 size(const QString &fileName) const;
+    quint64 totalSize(const QStringList &fileNames) const;
+};
+
+/**
+ * Reads the directories @p dirs and, if @p recursive is true, all
+ * directories below them. Every directory is read only once, in a
+ * single pass that also yields the types and sizes of its entries,
+ * and the directories of one level are read in parallel.
+ *
+ * The listings are returned level by level, so parents come before
+ * their children. @p progress, if set, is called with the number of
+ * directories read so far, from the calling thread.
+ */
+std::vector<DirectoryListing> scanDirectories(const QStringList &dirs, bool recursive,
+                                              const std::function<void(int)> &progress = std::function<void(int)>());
+
+/**
+ * The file name patterns of a set of checksum definitions, compiled
+ * once. Not thread-safe.
+ */
+class ChecksumFilePatterns
+{
+public:
+    explicit ChecksumFilePatterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions);
+
+    bool matches(const QString &fileName) const;
+    /** The definition the sum file @p fileName belongs to, if any. */
+    std::shared_ptr<ChecksumDefinition> definition(const QString &fileName) const;
+
+    /** The sum files among @p fileNames. */
+    QStringList sumFiles(const QStringList &fileNames) const;
+    /** @p fileNames without the sum files. */
+    QStringList withoutSumFiles(const QStringList &fileNames) const;
+
+private:
+    std::vector< std::pair<QRegExp, std::shared_ptr<ChecksumDefinition> > > m_patterns;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_CHECKSUMSCANNER_H__
@@ -52,6 +52,7 @@
 #include <QString>
 #include <QProcess>
 #include <QByteArray>
+#include <QMutex>
 #include <QStandardPaths>
 #include <QCoreApplication>
 #include <gpg-error.h>
@@ -216,7 +217,10 @@ QString Kleo::gpgConfListDir(const char *which)
 
 bool Kleo::engineIsVersion(int major, int minor, int patch, Engine engine)
 {
+    // called from worker threads, too (e.g. by the self-test checks)
+    static QMutex cachedVersionsMutex;
     static QMap<Engine, std::array<int, 3> > cachedVersions;
+    const QMutexLocker locker(&cachedVersionsMutex);
     const int required_version[] = {major, minor, patch};
     // Gpgconf means spawning processes which is expensive on windows.
     std::array<int, 3> actual_version;
@@ -30,6 +30,10 @@
 */
 #include "gui-helper.h"
 
+#include <KFormat>
+#include <KLocalizedString>
+
+#include <QProgressBar>
 #include <QWidget>
 
 #ifdef Q_OS_WIN
@@ -104,3 +108,21 @@ void Kleo::agressive_raise(QWidget *w, bool stayOnTop)
 #endif
 }
 
+void Kleo::setProgressBarThroughput(QProgressBar *bar, double bytesPerSecond, int secondsRemaining)
+{
+    if (!bar) {
+        return;
+    }
+    if (bytesPerSecond <= 0) {
+        bar->setFormat(QStringLiteral("%p%"));
+        return;
+    }
+    const KFormat format;
+    const QString rate = format.formatByteSize(bytesPerSecond);
+    if (secondsRemaining < 0) {
+        bar->setFormat(i18nc("%p% is the percentage, %1 the amount of data per second", "%p% (%1/s)", rate));
+    } else {
+        bar->setFormat(i18nc("%p% is the percentage, %1 the amount of data per second, %2 a duration",
+                             "%p% (%1/s, %2 left)", rate, format.formatSpelloutDuration(secondsRemaining * 1000ULL)));
+    }
+}
@@ -35,6 +35,7 @@
 
 #include <QAbstractButton>
 
+class QProgressBar;
 class QWidget;
 
 namespace Kleo
@@ -59,6 +60,10 @@ static inline bool xconnect(const QObject *a, const char *signal,
  * specific. */
 void agressive_raise(QWidget *w, bool stayOnTop);
 
+/** Shows @p bytesPerSecond and @p secondsRemaining (if not negative)
+ * next to the percentage of @p bar. */
+void setProgressBarThroughput(QProgressBar *bar, double bytesPerSecond, int secondsRemaining);
+
 }
 
 #endif /* __KLEOPATRA_UTILS_GUI_HELPER_H__ */
@@ -56,6 +56,15 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QProcess>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <cstring>
 
 #include <errno.h>
 
@@ -151,6 +160,371 @@ private:
     QString m_fileName;
 };
 
+// Reads the device of an input once and hands the data to several
+// readers. A reader that gets too far ahead waits until the slowest
+// reader catches up, so at most BufferLimit bytes are kept in memory.
+// The source device (usually a QProcess) is moved to a pump thread of
+// its own while it is read; the readers only ever see the buffered
+// chunks. The readers must read concurrently, or the fastest one
+// blocks forever.
+class TeeSource
+{
+public:
+    TeeSource(const std::shared_ptr<Input> &input, unsigned int readers)
+        : m_input(input),
+          m_mutex(),
+          m_changed(),
+          m_chunks(),
+          m_bufferStart(0),
+          m_bufferEnd(0),
+          m_positions(readers, 0),
+          m_eof(false),
+          m_stop(false),
+          m_failed(false),
+          m_errorString(),
+          m_pump(this)
+    {
+        // must happen in the thread the device lives in
+        if (const std::shared_ptr<QIODevice> io = m_input->ioDevice()) {
+            m_pump.setOwnerThread(io->thread());
+            io->moveToThread(&m_pump);
+        }
+        m_pump.start();
+    }
+    ~TeeSource()
+    {
+        {
+            const QMutexLocker locker(&m_mutex);
+            m_stop = true;
+            m_changed.wakeAll();
+        }
+        m_pump.wait();
+    }
+
+    const std::shared_ptr<Input> &input() const
+    {
+        return m_input;
+    }
+
+    // Only known once the source has been read completely
+    bool failed() const
+    {
+        const QMutexLocker locker(&m_mutex);
+        return m_failed;
+    }
+    QString errorString() const
+    {
+        const QMutexLocker locker(&m_mutex);
+        return m_errorString;
+    }
+
+    qint64 available(unsigned int reader) const
+    {
+        const QMutexLocker locker(&m_mutex);
+        return m_positions[reader] < 0 ? 0 : m_bufferEnd - m_positions[reader];
+    }
+
+    qint64 read(unsigned int reader, char *data, qint64 maxSize)
+    {
+        const QMutexLocker locker(&m_mutex);
+        if (!waitForData(reader)) {
+            return 0;
+        }
+        qint64 &pos = m_positions[reader];
+        qint64 chunkStart = m_bufferStart;
+        qint64 copied = 0;
+        for (const QByteArray &chunk : m_chunks) {
+            const qint64 chunkEnd = chunkStart + chunk.size();
+            if (pos < chunkEnd) {
+                const qint64 n = std::min(maxSize - copied, chunkEnd - pos);
+                std::memcpy(data + copied, chunk.constData() + (pos - chunkStart), n);
+                copied += n;
+                pos += n;
+                if (copied == maxSize) {
+                    break;
+                }
+            }
+            chunkStart = chunkEnd;
+        }
+        dropConsumedChunks();
+        return copied;
+    }
+
+    bool waitForReadyRead(unsigned int reader)
+    {
+        const QMutexLocker locker(&m_mutex);
+        return waitForData(reader);
+    }
+
+    void detach(unsigned int reader)
+    {
+        const QMutexLocker locker(&m_mutex);
+        if (m_positions[reader] < 0) {
+            return;
+        }
+        m_positions[reader] = -1;
+        if (std::all_of(m_positions.begin(), m_positions.end(), [](qint64 p) { return p < 0; })) {
+            // nobody is interested in the rest; the pump closes the source
+            m_stop = true;
+        }
+        dropConsumedChunks();
+    }
+
+private:
+    enum { ChunkSize = 64 * 1024, BufferLimit = 4 * 1024 * 1024 };
+
+    class Pump : public QThread
+    {
+    public:
+        explicit Pump(TeeSource *source)
+            : QThread(), m_source(source), m_ownerThread(nullptr) {}
+        void setOwnerThread(QThread *thread)
+        {
+            m_ownerThread = thread;
+        }
+    protected:
+        void run() override
+        {
+            m_source->pump();
+            // hand the device back, so that it is closed and deleted
+            // where it came from
+            if (const std::shared_ptr<QIODevice> io = m_source->m_input->ioDevice()) {
+                if (m_ownerThread) {
+                    io->moveToThread(m_ownerThread);
+                }
+            }
+        }
+    private:
+        TeeSource *const m_source;
+        QThread *m_ownerThread;
+    };
+
+    qint64 slowestPosition() const
+    {
+        qint64 result = m_bufferEnd;
+        for (qint64 p : m_positions) {
+            if (p >= 0) {
+                result = std::min(result, p);
+            }
+        }
+        return result;
+    }
+
+    void dropConsumedChunks()
+    {
+        const qint64 slowest = slowestPosition();
+        while (!m_chunks.empty() && m_bufferStart + m_chunks.front().size() <= slowest) {
+            m_bufferStart += m_chunks.front().size();
+            m_chunks.pop_front();
+        }
+        m_changed.wakeAll();
+    }
+
+    // Called with m_mutex locked. Returns false at the end of the data
+    bool waitForData(unsigned int reader)
+    {
+        Q_FOREVER {
+            const qint64 pos = m_positions[reader];
+            if (pos < 0) {
+                return false;
+            }
+            if (pos < m_bufferEnd) {
+                return true;
+            }
+            if (m_eof) {
+                return false;
+            }
+            m_changed.wait(&m_mutex);
+        }
+    }
+
+    // Runs in the pump thread, which owns the source device
+    void pump()
+    {
+        const std::shared_ptr<QIODevice> io = m_input->ioDevice();
+        Q_FOREVER {
+            {
+                const QMutexLocker locker(&m_mutex);
+                while (!m_stop && m_bufferEnd - slowestPosition() >= BufferLimit) {
+                    m_changed.wait(&m_mutex);
+                }
+                if (m_stop) {
+                    break;
+                }
+            }
+            const QByteArray chunk = io ? readFromSource(*io) : QByteArray();
+            const QMutexLocker locker(&m_mutex);
+            if (chunk.isEmpty()) {
+                break;
+            }
+            m_chunks.push_back(chunk);
+            m_bufferEnd += chunk.size();
+            m_changed.wakeAll();
+        }
+
+        m_input->finalize();
+        const bool failed = m_input->failed();
+        const QString errorString = m_input->errorString();
+        const QMutexLocker locker(&m_mutex);
+        m_failed = failed;
+        m_errorString = errorString;
+        m_eof = true;
+        m_changed.wakeAll();
+    }
+
+    QByteArray readFromSource(QIODevice &io)
+    {
+        QByteArray chunk(ChunkSize, Qt::Uninitialized);
+        Q_FOREVER {
+            qint64 n = io.read(chunk.data(), chunk.size());
+            if (n == 0 && io.waitForReadyRead(100)) {
+                continue;
+            }
+            if (n == 0 && isRunningProcess(io)) {
+                // timed out; keep waiting unless all readers are gone
+                if (isStopping()) {
+                    return QByteArray();
+                }
+                continue;
+            }
+            if (n == 0) {
+                // the process may have exited with data still buffered
+                n = io.read(chunk.data(), chunk.size());
+            }
+            if (n <= 0) {
+                return QByteArray();
+            }
+            chunk.truncate(n);
+            return chunk;
+        }
+    }
+
+    static bool isRunningProcess(const QIODevice &io)
+    {
+        const QProcess *const process = qobject_cast<const QProcess *>(&io);
+        return process && process->state() != QProcess::NotRunning;
+    }
+
+    bool isStopping() const
+    {
+        const QMutexLocker locker(&m_mutex);
+        return m_stop;
+    }
+
+private:
+    const std::shared_ptr<Input> m_input;
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    std::deque<QByteArray> m_chunks;
+    qint64 m_bufferStart;
+    qint64 m_bufferEnd;
+    std::vector<qint64> m_positions; // -1: reader is gone
+    bool m_eof;
+    bool m_stop;
+    bool m_failed;
+    QString m_errorString;
+    Pump m_pump;
+};
+
+class TeeDevice : public QIODevice
+{
+public:
+    TeeDevice(const std::shared_ptr<TeeSource> &source, unsigned int reader)
+        : QIODevice(),
+          m_source(source),
+          m_reader(reader)
+    {
+    }
+    ~TeeDevice() override
+    {
+        m_source->detach(m_reader);
+    }
+
+    bool open(OpenMode mode) override
+    {
+        if ((mode & ReadWrite) != ReadOnly) {
+            setErrorString(QStringLiteral("TeeDevice is read-only"));
+            return false;
+        }
+        return QIODevice::open(mode | Unbuffered);
+    }
+    void close() override
+    {
+        m_source->detach(m_reader);
+        QIODevice::close();
+    }
+    bool isSequential() const override
+    {
+        return true;
+    }
+    qint64 bytesAvailable() const override
+    {
+        return QIODevice::bytesAvailable() + m_source->available(m_reader);
+    }
+    bool waitForReadyRead(int) override
+    {
+        return m_source->waitForReadyRead(m_reader);
+    }
+
+protected:
+    // blocks until data is available, like reading from a pipe
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        return m_source->read(m_reader, data, maxSize);
+    }
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    const std::shared_ptr<TeeSource> m_source;
+    const unsigned int m_reader;
+};
+
+class TeeInput : public InputImplBase
+{
+public:
+    TeeInput(const std::shared_ptr<TeeSource> &source, unsigned int reader)
+        : InputImplBase(),
+          m_source(source),
+          m_io(new TeeDevice(source, reader))
+    {
+        m_io->open(QIODevice::ReadOnly);
+    }
+
+    QString label() const override
+    {
+        return m_source->input()->label();
+    }
+    std::shared_ptr<QIODevice> ioDevice() const override
+    {
+        return m_io;
+    }
+    unsigned int classification() const override
+    {
+        return m_source->input()->classification();
+    }
+    unsigned long long size() const override
+    {
+        return m_source->input()->size();
+    }
+    bool failed() const override
+    {
+        return m_source->failed();
+    }
+
+private:
+    QString doErrorString() const override
+    {
+        return m_source->errorString();
+    }
+
+private:
+    const std::shared_ptr<TeeSource> m_source;
+    const std::shared_ptr<TeeDevice> m_io;
+};
+
 #ifndef QT_NO_CLIPBOARD
 class ClipboardInput : public Input
 {
@@ -272,7 +646,9 @@ FileInput::FileInput(const QString &fileName)
     std::shared_ptr<QFile> file(new QFile(fileName));
 
     errno = 0;
-    if (!file->open(QIODevice::ReadOnly))
+    // gpgme reads in blocks of its own, so QFile's buffer would only add
+    // a copy on the way
+    if (!file->open(QIODevice::ReadOnly | QIODevice::Unbuffered))
         throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
                         i18n("Could not open file \"%1\" for reading", fileName));
     m_io = Log::instance()->createIOLogger(file, QStringLiteral("file-in"), Log::Read);
@@ -288,7 +664,7 @@ FileInput::FileInput(const std::shared_ptr<QFile> &file)
     if (file->isOpen() && !file->isReadable())
         throw Exception(gpg_error(GPG_ERR_INV_ARG),
                         i18n("File \"%1\" is already open, but not for reading", file->fileName()));
-    if (!file->isOpen() && !file->open(QIODevice::ReadOnly))
+    if (!file->isOpen() && !file->open(QIODevice::ReadOnly | QIODevice::Unbuffered))
         throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
                         i18n("Could not open file \"%1\" for reading", m_fileName));
     m_io = Log::instance()->createIOLogger(file, QStringLiteral("file-in"), Log::Read);
@@ -299,6 +675,21 @@ unsigned int FileInput::classification() const
     return classify(m_fileName);
 }
 
+std::vector<std::shared_ptr<Input> > Input::createTee(const std::shared_ptr<Input> &input, unsigned int count)
+{
+    kleo_assert(input);
+    if (count <= 1) {
+        return std::vector<std::shared_ptr<Input> >(count, input);
+    }
+    const std::shared_ptr<TeeSource> source(new TeeSource(input, count));
+    std::vector<std::shared_ptr<Input> > result;
+    result.reserve(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        result.push_back(std::shared_ptr<Input>(new TeeInput(source, i)));
+    }
+    return result;
+}
+
 std::shared_ptr<Input> Input::createFromProcessStdOut(const QString &command)
 {
     return std::shared_ptr<Input>(new ProcessStdOutInput(command, QStringList(), QDir::current()));
@@ -36,6 +36,7 @@
 #include <kleo-assuan.h> // for assuan_fd_t
 
 #include <memory>
+#include <vector>
 
 class QIODevice;
 class QString;
@@ -77,6 +78,11 @@ public:
     static std::shared_ptr<Input> createFromClipboard();
 #endif
     static std::shared_ptr<Input> createFromByteArray(QByteArray *data, const QString &label);
+    /** Returns @p count inputs that all deliver the data of @p input,
+        which is read only once. The returned inputs must be read
+        concurrently: one that gets too far ahead of the others blocks
+        until they catch up. */
+    static std::vector<std::shared_ptr<Input> > createTee(const std::shared_ptr<Input> &input, unsigned int count);
 };
 }
 
@@ -31,6 +31,7 @@
 #include <cstring>
 #include <memory>
 #include <algorithm>
+#include <vector>
 
 #ifdef Q_OS_WIN32
 # ifndef NOMINMAX
@@ -41,6 +42,7 @@
 #else
 # include <unistd.h>
 # include <errno.h>
+# include <poll.h>
 #endif
 
 #ifndef KDAB_CHECK_THIS
@@ -52,12 +54,14 @@
 #define LOCKED( d ) const QMutexLocker locker( &d->mutex )
 #define synchronized( d ) if ( int i = 0 ) {} else for ( const QMutexLocker locker( &d->mutex ) ; !i ; ++i )
 
-const unsigned int BUFFER_SIZE = 4096;
+const unsigned int DEFAULT_BUFFER_SIZE = 256 * 1024;
+const unsigned int MIN_BUFFER_SIZE = 4096;
 const bool ALLOW_QIODEVICE_BUFFERING = true;
 
 namespace
 {
 KDPipeIODevice::DebugLevel s_debugLevel = KDPipeIODevice::NoDebug;
+unsigned int s_bufferSize = DEFAULT_BUFFER_SIZE;
 }
 
 #define QDebug if( s_debugLevel == KDPipeIODevice::NoDebug ){}else qDebug
@@ -69,19 +73,19 @@ class Reader : public QThread
 {
     Q_OBJECT
 public:
-    Reader(int fd, Qt::HANDLE handle);
+    Reader(int fd, Qt::HANDLE handle, unsigned int bufferSize);
     ~Reader() override;
 
     qint64 readData(char *data, qint64 maxSize);
 
     unsigned int bytesInBuffer() const
     {
-        return (wptr + sizeof buffer - rptr) % sizeof buffer;
+        return (wptr + buffer.size() - rptr) % buffer.size();
     }
 
     bool bufferFull() const
     {
-        return bytesInBuffer() == sizeof buffer - 1;
+        return bytesInBuffer() == buffer.size() - 1;
     }
 
     bool bufferEmpty() const
@@ -93,12 +97,15 @@ public:
     {
         const unsigned int bib = bytesInBuffer();
         for (unsigned int i = rptr; i < rptr + bib; ++i)
-            if (buffer[i % sizeof buffer] == ch) {
+            if (buffer[i % buffer.size()] == ch) {
                 return true;
             }
         return false;
     }
 
+    // Whether a read() would return without blocking (data or eof pending).
+    bool moreDataAvailable() const;
+
     void notifyReadyRead();
 
 Q_SIGNALS:
@@ -128,10 +135,10 @@ public:
 
 private:
     unsigned int rptr, wptr;
-    char buffer[BUFFER_SIZE + 1]; // need to keep one byte free to detect empty state
+    std::vector<char> buffer; // need to keep one byte free to detect empty state
 };
 
-Reader::Reader(int fd_, Qt::HANDLE handle_) : QThread(),
+Reader::Reader(int fd_, Qt::HANDLE handle_, unsigned int bufferSize) : QThread(),
     fd(fd_),
     handle(handle_),
     mutex(),
@@ -146,35 +153,57 @@ Reader::Reader(int fd_, Qt::HANDLE handle_) : QThread(),
     isReading(false),
     consumerBlocksOnUs(false),
     rptr(0),
-    wptr(0)
+    wptr(0),
+    buffer(bufferSize + 1)
 {
 
 }
 
 Reader::~Reader() {}
 
+bool Reader::moreDataAvailable() const
+{
+#ifdef Q_OS_WIN32
+    DWORD avail = 0;
+    return PeekNamedPipe(handle, nullptr, 0, nullptr, &avail, nullptr) && avail > 0;
+#else
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rc;
+    do {
+        rc = ::poll(&pfd, 1, 0);
+    } while (rc == -1 && errno == EINTR);
+    // POLLHUP/POLLERR: read() won't block either, but report eof/error
+    return rc > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR));
+#endif
+}
+
 class Writer : public QThread
 {
     Q_OBJECT
 public:
-    Writer(int fd, Qt::HANDLE handle);
+    Writer(int fd, Qt::HANDLE handle, unsigned int bufferSize);
     ~Writer() override;
 
     qint64 writeData(const char *data, qint64 size);
 
     unsigned int bytesInBuffer() const
     {
-        return numBytesInBuffer;
+        return numBytesInBuffer + numBytesInFlight;
     }
 
+    // whether the consumer has to wait before it can hand us more data
     bool bufferFull() const
     {
-        return numBytesInBuffer == sizeof buffer;
+        return numBytesInBuffer == buffer.size();
     }
 
+    // whether everything handed to us has been written
     bool bufferEmpty() const
     {
-        return numBytesInBuffer == 0;
+        return numBytesInBuffer == 0 && numBytesInFlight == 0;
     }
 
 Q_SIGNALS:
@@ -190,27 +219,37 @@ public:
     QMutex mutex;
     QWaitCondition bufferEmptyCondition;
     QWaitCondition bufferNotEmptyCondition;
+    QWaitCondition bufferNotFullCondition;
     QWaitCondition hasStarted;
     bool cancel;
     bool error;
     int errorCode;
 private:
+    // Double-buffered: the consumer fills 'buffer' while run() writes
+    // out 'inFlight' with the mutex released; run() swaps them when
+    // 'inFlight' has been written completely.
     unsigned int numBytesInBuffer;
-    char buffer[BUFFER_SIZE];
+    unsigned int numBytesInFlight;
+    std::vector<char> buffer;
+    std::vector<char> inFlight;
 };
 }
 
-Writer::Writer(int fd_, Qt::HANDLE handle_) : QThread(),
+Writer::Writer(int fd_, Qt::HANDLE handle_, unsigned int bufferSize) : QThread(),
     fd(fd_),
     handle(handle_),
     mutex(),
     bufferEmptyCondition(),
     bufferNotEmptyCondition(),
+    bufferNotFullCondition(),
     hasStarted(),
     cancel(false),
     error(false),
     errorCode(0),
-    numBytesInBuffer(0)
+    numBytesInBuffer(0),
+    numBytesInFlight(0),
+    buffer(bufferSize),
+    inFlight(bufferSize)
 {
 
 }
@@ -254,6 +293,16 @@ void KDPipeIODevice::setDebugLevel(KDPipeIODevice::DebugLevel level)
     s_debugLevel = level;
 }
 
+unsigned int KDPipeIODevice::bufferSize()
+{
+    return s_bufferSize;
+}
+
+void KDPipeIODevice::setBufferSize(unsigned int size)
+{
+    s_bufferSize = std::max(size, MIN_BUFFER_SIZE);
+}
+
 KDPipeIODevice::Private::Private(KDPipeIODevice *qq) : QObject(qq), q(qq),
     fd(-1),
     handle(nullptr),
@@ -408,14 +457,14 @@ bool KDPipeIODevice::Private::doOpen(int fd_, Qt::HANDLE handle_, OpenMode mode_
     std::unique_ptr<Writer> writer_;
 
     if (mode_ & ReadOnly) {
-        reader_.reset(new Reader(fd_, handle_));
+        reader_.reset(new Reader(fd_, handle_, s_bufferSize));
         QDebug("KDPipeIODevice::doOpen (%p): created reader (%p) for fd %d", (void *)this,
                (void *)reader_.get(), fd_);
         connect(reader_.get(), &Reader::readyRead, this, &Private::emitReadyRead,
                 Qt::QueuedConnection);
     }
     if (mode_ & WriteOnly) {
-        writer_.reset(new Writer(fd_, handle_));
+        writer_.reset(new Writer(fd_, handle_, s_bufferSize));
         QDebug("KDPipeIODevice::doOpen (%p): created writer (%p) for fd %d",
                (void *)this, (void *)writer_.get(), fd_);
         connect(writer_.get(), &Writer::bytesWritten, q, &QIODevice::bytesWritten,
@@ -646,7 +695,7 @@ qint64 KDPipeIODevice::readData(char *data, qint64 maxSize)
 
 qint64 Reader::readData(char *data, qint64 maxSize)
 {
-    qint64 numRead = rptr < wptr ? wptr - rptr : sizeof buffer - rptr;
+    qint64 numRead = rptr < wptr ? wptr - rptr : buffer.size() - rptr;
     if (numRead > maxSize) {
         numRead = maxSize;
     }
@@ -654,9 +703,9 @@ qint64 Reader::readData(char *data, qint64 maxSize)
     QDebug("%p: KDPipeIODevice::readData: data=%p, maxSize=%lld; rptr=%u, wptr=%u (bytesInBuffer=%u); -> numRead=%lld",
            (void *)this, data, maxSize, rptr, wptr, bytesInBuffer(), numRead);
 
-    memcpy(data, buffer + rptr, numRead);
+    memcpy(data, buffer.data() + rptr, numRead);
 
-    rptr = (rptr + numRead) % sizeof buffer;
+    rptr = (rptr + numRead) % buffer.size();
 
     if (!bufferFull()) {
         QDebug("%p: KDPipeIODevice::readData: signal bufferNotFullCondition", (void *) this);
@@ -679,34 +728,38 @@ qint64 KDPipeIODevice::writeData(const char *data, qint64 size)
 
     LOCKED(w);
 
-    while (!w->error && !w->bufferEmpty()) {
-        QDebug("%p: KDPipeIODevice::writeData: wait for empty buffer", (void *) this);
-        w->bufferEmptyCondition.wait(&w->mutex);
-        QDebug("%p: KDPipeIODevice::writeData: empty buffer signaled", (void *) this);
+    while (!w->error && w->bufferFull()) {
+        QDebug("%p: KDPipeIODevice::writeData: wait for non-full buffer", (void *) this);
+        w->bufferNotFullCondition.wait(&w->mutex);
+        QDebug("%p: KDPipeIODevice::writeData: non-full buffer signaled", (void *) this);
 
     }
     if (w->error) {
         return -1;
     }
 
-    Q_ASSERT(w->bufferEmpty());
+    Q_ASSERT(!w->bufferFull());
 
     return w->writeData(data, size);
 }
 
 qint64 Writer::writeData(const char *data, qint64 size)
 {
-    Q_ASSERT(bufferEmpty());
+    Q_ASSERT(!bufferFull());
 
-    if (size > static_cast<qint64>(sizeof buffer)) {
-        size = sizeof buffer;
+    const qint64 space = buffer.size() - numBytesInBuffer;
+    if (size > space) {
+        size = space;
     }
 
-    memcpy(buffer, data, size);
+    memcpy(buffer.data() + numBytesInBuffer, data, size);
 
-    numBytesInBuffer = size;
+    const bool wasEmpty = numBytesInBuffer == 0;
+    numBytesInBuffer += size;
 
-    if (!bufferEmpty()) {
+    // only wake the writer thread on the empty -> non-empty transition;
+    // while it's busy writing, it will pick up the rest by itself:
+    if (wasEmpty && size > 0) {
         bufferNotEmptyCondition.wakeAll();
     }
     return size;
@@ -801,8 +854,13 @@ void Reader::run()
                 waitForCancelCondition.wait(&mutex);
             }
         } else if (!cancel && !bufferFull() && !bufferEmpty()) {
-            QDebug("%p: Reader::run: buffer no longer empty, waking everyone", (void *) this);
-            notifyReadyRead();
+            // batch wakeups: as long as the pipe has more data for us and
+            // the buffer is less than half full, keep on reading instead
+            // of handing every single chunk to the consumer:
+            if (bytesInBuffer() >= buffer.size() / 2 || !moreDataAvailable()) {
+                QDebug("%p: Reader::run: buffer no longer empty, waking everyone", (void *) this);
+                notifyReadyRead();
+            }
         }
 
         while (!cancel && !error && bufferFull()) {
@@ -823,9 +881,9 @@ void Reader::run()
                 rptr = wptr = 0;
             }
 
-            unsigned int numBytes = (rptr + sizeof buffer - wptr - 1) % sizeof buffer;
-            if (numBytes > sizeof buffer - wptr) {
-                numBytes = sizeof buffer - wptr;
+            unsigned int numBytes = (rptr + buffer.size() - wptr - 1) % buffer.size();
+            if (numBytes > buffer.size() - wptr) {
+                numBytes = buffer.size() - wptr;
             }
 
             QDebug("%p: Reader::run: rptr=%d, wptr=%d -> numBytes=%d", (void *)this, rptr, wptr, numBytes);
@@ -837,7 +895,7 @@ void Reader::run()
             isReading = true;
             mutex.unlock();
             DWORD numRead;
-            const bool ok = ReadFile(handle, buffer + wptr, numBytes, &numRead, 0);
+            const bool ok = ReadFile(handle, buffer.data() + wptr, numBytes, &numRead, 0);
             mutex.lock();
             isReading = false;
             if (ok) {
@@ -861,7 +919,7 @@ void Reader::run()
             qint64 numRead;
             mutex.unlock();
             do {
-                numRead = ::read(fd, buffer + wptr, numBytes);
+                numRead = ::read(fd, buffer.data() + wptr, numBytes);
             } while (numRead == -1 && errno == EINTR);
             mutex.lock();
 
@@ -875,11 +933,11 @@ void Reader::run()
             }
 #endif
             QDebug("%p (fd=%d): Reader::run: read %ld bytes", (void *) this, fd, static_cast<long>(numRead));
-            QDebug("%p (fd=%d): Reader::run: %s", (void *)this, fd, buffer);
+            QDebug("%p (fd=%d): Reader::run: %s", (void *)this, fd, buffer.data());
 
             if (numRead > 0) {
                 QDebug("%p: Reader::run: buffer before: rptr=%4d, wptr=%4d", (void *)this, rptr, wptr);
-                wptr = (wptr + numRead) % sizeof buffer;
+                wptr = (wptr + numRead) % buffer.size();
                 QDebug("%p: Reader::run: buffer after:  rptr=%4d, wptr=%4d", (void *)this, rptr, wptr);
             }
         }
@@ -931,17 +989,25 @@ void Writer::run()
         }
 
         Q_ASSERT(numBytesInBuffer > 0);
+        Q_ASSERT(numBytesInFlight == 0);
+
+        // take over what the consumer gave us, so it can refill the
+        // other buffer while we're writing this one:
+        buffer.swap(inFlight);
+        numBytesInFlight = numBytesInBuffer;
+        numBytesInBuffer = 0;
+        bufferNotFullCondition.wakeAll();
 
-        qCDebug(KLEOPATRA_LOG) << this << "Writer::run: Trying to write " << numBytesInBuffer << "bytes";
+        qCDebug(KLEOPATRA_LOG) << this << "Writer::run: Trying to write " << numBytesInFlight << "bytes";
         qint64 totalWritten = 0;
         do {
             mutex.unlock();
 #ifdef Q_OS_WIN32
             DWORD numWritten;
-            QDebug("%p (fd=%d): Writer::run: buffer before WriteFile (numBytes=%lld): %s:",
-                   (void *) this, fd, numBytesInBuffer, buffer);
+            QDebug("%p (fd=%d): Writer::run: buffer before WriteFile (numBytes=%u): %s:",
+                   (void *) this, fd, numBytesInFlight, inFlight.data());
             QDebug("%p (fd=%d): Writer::run: Going into WriteFile", (void *) this, fd);
-            if (!WriteFile(handle, buffer + totalWritten, numBytesInBuffer - totalWritten, &numWritten, 0)) {
+            if (!WriteFile(handle, inFlight.data() + totalWritten, numBytesInFlight - totalWritten, &numWritten, 0)) {
                 mutex.lock();
                 errorCode = static_cast<int>(GetLastError());
                 QDebug("%p: Writer::run: got error code: %d", (void *) this, errorCode);
@@ -951,7 +1017,7 @@ void Writer::run()
 #else
             qint64 numWritten;
             do {
-                numWritten = ::write(fd, buffer + totalWritten, numBytesInBuffer - totalWritten);
+                numWritten = ::write(fd, inFlight.data() + totalWritten, numBytesInFlight - totalWritten);
             } while (numWritten == -1 && errno == EINTR);
 
             if (numWritten < 0) {
@@ -962,22 +1028,26 @@ void Writer::run()
                 goto leave;
             }
 #endif
-            QDebug("%p (fd=%d): Writer::run: buffer after WriteFile (numBytes=%u): %s:", (void *)this, fd, numBytesInBuffer, buffer);
+            QDebug("%p (fd=%d): Writer::run: buffer after WriteFile (numBytes=%u): %s:", (void *)this, fd, numBytesInFlight, inFlight.data());
             totalWritten += numWritten;
             mutex.lock();
-        } while (totalWritten < numBytesInBuffer);
+        } while (totalWritten < numBytesInFlight);
 
         qCDebug(KLEOPATRA_LOG) << this << "Writer::run: wrote " << totalWritten << "bytes";
-        numBytesInBuffer = 0;
-        qCDebug(KLEOPATRA_LOG) << this << "Writer::run: buffer is empty, wake bufferEmptyCond listeners";
-        bufferEmptyCondition.wakeAll();
+        numBytesInFlight = 0;
+        if (bufferEmpty()) {
+            qCDebug(KLEOPATRA_LOG) << this << "Writer::run: buffer is empty, wake bufferEmptyCond listeners";
+            bufferEmptyCondition.wakeAll();
+        }
         Q_EMIT bytesWritten(totalWritten);
     }
 leave:
     qCDebug(KLEOPATRA_LOG) << this << "Writer::run: terminating";
     numBytesInBuffer = 0;
+    numBytesInFlight = 0;
     qCDebug(KLEOPATRA_LOG) << this << "Writer::run: buffer is empty, wake bufferEmptyCond listeners";
     bufferEmptyCondition.wakeAll();
+    bufferNotFullCondition.wakeAll();
     Q_EMIT bytesWritten(0);
 }
 
@@ -993,7 +1063,7 @@ std::pair<KDPipeIODevice *, KDPipeIODevice *> KDPipeIODevice::makePairOfConnecte
     memset(&sa, 0, sizeof(sa));
     sa.nLength = sizeof(sa);
     sa.bInheritHandle = TRUE;
-    if (CreatePipe(&rh, &wh, &sa, BUFFER_SIZE)) {
+    if (CreatePipe(&rh, &wh, &sa, s_bufferSize)) {
         read = new KDPipeIODevice;
         read->open(rh, ReadOnly);
         write = new KDPipeIODevice;
@@ -37,6 +37,11 @@ public:
     static DebugLevel debugLevel();
     static void setDebugLevel(DebugLevel level);
 
+    /** Size of the per-direction buffers of devices opened from now on
+        (default: 256 KiB, minimum: 4 KiB). */
+    static unsigned int bufferSize();
+    static void setBufferSize(unsigned int size);
+
     explicit KDPipeIODevice(QObject *parent = nullptr);
     explicit KDPipeIODevice(int fd, OpenMode = ReadOnly, QObject *parent = nullptr);
     explicit KDPipeIODevice(Qt::HANDLE handle, OpenMode = ReadOnly, QObject *parent = nullptr);
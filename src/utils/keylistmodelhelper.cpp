@@ -0,0 +1,95 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keylistmodelhelper.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "keylistmodelhelper.h"
+
+#include <Libkleo/KeyListModel>
+#include <Libkleo/Predicates>
+
+#include <gpgme++/key.h>
+
+#include <QAbstractItemView>
+#include <QSortFilterProxyModel>
+
+#include <algorithm>
+
+using namespace Kleo;
+using namespace GpgME;
+
+void Kleo::removeKeysFromModel(AbstractKeyListModel *model, const std::vector<Key> &keys)
+{
+    if (!model || keys.empty()) {
+        return;
+    }
+
+    std::vector<Key> sorted = keys;
+    _detail::sort_by_fpr(sorted);
+    _detail::remove_duplicates_by_fpr(sorted);
+
+    // The libkleo models only remove single keys. Each removal is a
+    // beginRemoveRows()/endRemoveRows() pair, which keeps the selection,
+    // the current index and the expansion state of attached views intact
+    // (a reset would lose all of them).
+    for (const Key &key : sorted) {
+        model->removeKey(key);
+    }
+}
+
+SortFilterSuspender::SortFilterSuspender(const std::vector<QAbstractItemView *> &views)
+    : m_proxies()
+{
+    for (const QAbstractItemView *view : views) {
+        const QAbstractProxyModel *proxy = view ? qobject_cast<const QAbstractProxyModel *>(view->model()) : nullptr;
+        while (proxy) {
+            QSortFilterProxyModel *const sfp = qobject_cast<QSortFilterProxyModel *>(const_cast<QAbstractProxyModel *>(proxy));
+            if (sfp && sfp->dynamicSortFilter()
+                    && std::find(m_proxies.cbegin(), m_proxies.cend(), sfp) == m_proxies.cend()) {
+                sfp->setDynamicSortFilter(false);
+                m_proxies.push_back(sfp);
+            }
+            proxy = qobject_cast<const QAbstractProxyModel *>(proxy->sourceModel());
+        }
+    }
+}
+
+SortFilterSuspender::~SortFilterSuspender()
+{
+    // innermost proxies first; they were collected from the views down
+    for (auto it = m_proxies.rbegin(); it != m_proxies.rend(); ++it) {
+        if (QSortFilterProxyModel *const sfp = *it) {
+            sfp->setDynamicSortFilter(true);
+            sfp->invalidate();
+        }
+    }
+}
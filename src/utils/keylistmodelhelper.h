@@ -0,0 +1,80 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keylistmodelhelper.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_UTILS_KEYLISTMODELHELPER_H__
+#define __KLEOPATRA_UTILS_KEYLISTMODELHELPER_H__
+
+#include <QPointer>
+
+#include <vector>
+
+class QAbstractItemView;
+class QSortFilterProxyModel;
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+class AbstractKeyListModel;
+
+/**
+ * Removes @p keys from @p model.
+ *
+ * Duplicates in @p keys are ignored. The keys are removed one by one
+ * with row removals, never with a model reset, so that views attached
+ * to @p model keep their selection and expansion state.
+ */
+void removeKeysFromModel(AbstractKeyListModel *model, const std::vector<GpgME::Key> &keys);
+
+/**
+ * Turns off dynamic sorting and filtering of the QSortFilterProxyModels
+ * between the given views and their source models for as long as it
+ * lives. On destruction, each proxy is re-sorted and re-filtered once
+ * with invalidate(), instead of once per change made in between.
+ */
+class SortFilterSuspender
+{
+public:
+    explicit SortFilterSuspender(const std::vector<QAbstractItemView *> &views);
+    ~SortFilterSuspender();
+
+private:
+    Q_DISABLE_COPY(SortFilterSuspender)
+    std::vector<QPointer<QSortFilterProxyModel> > m_proxies;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_KEYLISTMODELHELPER_H__
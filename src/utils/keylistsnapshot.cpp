@@ -0,0 +1,240 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keylistsnapshot.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "keylistsnapshot.h"
+
+#include "gnupg-helper.h"
+
+#include <Libkleo/Formatting>
+
+#include "kleopatra_debug.h"
+
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+#include <gpgme++/key.h>
+
+using namespace Kleo;
+
+namespace
+{
+
+static const quint32 snapshotMagic = 0x4b4c5353; // "KLSS"
+static const quint32 snapshotVersion = 1;
+
+static QString snapshotFileName()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+           .absoluteFilePath(QStringLiteral("keylist-snapshot"));
+}
+
+// Changes whenever one of the files that influence the key listing
+// is modified.
+static QByteArray keyringStamp()
+{
+    static const char *const files[] = {
+        "pubring.kbx", "pubring.gpg", "secring.gpg", "trustdb.gpg", "tofu.db",
+        "trustlist.txt", "private-keys-v1.d",
+    };
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const QDir homeDir(gnupgHomeDirectory());
+    for (const char *file : files) {
+        const QFileInfo fi(homeDir.absoluteFilePath(QLatin1String(file)));
+        hash.addData(file);
+        if (fi.exists()) {
+            hash.addData(QByteArray::number(fi.size()));
+            hash.addData(QByteArray::number(fi.lastModified().toMSecsSinceEpoch()));
+        }
+        hash.addData("\n", 1);
+    }
+    return hash.result();
+}
+
+static KeyListSnapshotEntry entryFromKey(const GpgME::Key &key)
+{
+    KeyListSnapshotEntry entry;
+    entry.fingerprint = QByteArray(key.primaryFingerprint());
+    entry.name = Formatting::prettyName(key);
+    entry.email = Formatting::prettyEMail(key);
+    entry.validity = key.userID(0).validity();
+    if (key.hasSecret()) {
+        entry.flags |= KeyListSnapshotEntry::HasSecret;
+    }
+    if (key.isExpired()) {
+        entry.flags |= KeyListSnapshotEntry::Expired;
+    }
+    if (key.isRevoked()) {
+        entry.flags |= KeyListSnapshotEntry::Revoked;
+    }
+    if (key.isDisabled()) {
+        entry.flags |= KeyListSnapshotEntry::Disabled;
+    }
+    if (key.isInvalid()) {
+        entry.flags |= KeyListSnapshotEntry::Invalid;
+    }
+    if (key.protocol() == GpgME::CMS) {
+        entry.flags |= KeyListSnapshotEntry::CMS;
+    }
+    return entry;
+}
+
+// Serializes the writers and lets a writer drop its data if a newer
+// snapshot has been queued in the meantime.
+static QMutex writeMutex;
+static QAtomicInt latestGeneration;
+
+static void writeSnapshot(const QByteArray &stamp, const std::vector<KeyListSnapshotEntry> &entries, int generation)
+{
+    QMutexLocker locker(&writeMutex);
+    if (generation != latestGeneration.load()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString fileName = snapshotFileName();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCDebug(KLEOPATRA_LOG) << "Failed to write key list snapshot:" << file.errorString();
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_9);
+    stream << snapshotMagic << snapshotVersion << stamp << quint32(entries.size());
+    for (const KeyListSnapshotEntry &entry : entries) {
+        stream << entry.fingerprint << entry.name << entry.email
+               << qint32(entry.validity) << quint32(entry.flags);
+    }
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        qCDebug(KLEOPATRA_LOG) << "Failed to write key list snapshot:" << file.errorString();
+        return;
+    }
+    qCDebug(KLEOPATRA_LOG) << "Wrote key list snapshot with" << entries.size()
+                           << "certificates in" << timer.elapsed() << "ms";
+}
+
+class SnapshotWriter : public QRunnable
+{
+public:
+    SnapshotWriter(const QByteArray &stamp, std::vector<KeyListSnapshotEntry> &&entries, int generation)
+        : QRunnable(), m_stamp(stamp), m_entries(std::move(entries)), m_generation(generation) {}
+
+    void run() override
+    {
+        writeSnapshot(m_stamp, m_entries, m_generation);
+    }
+
+private:
+    const QByteArray m_stamp;
+    const std::vector<KeyListSnapshotEntry> m_entries;
+    const int m_generation;
+};
+
+}
+
+std::vector<KeyListSnapshotEntry> Kleo::loadKeyListSnapshot()
+{
+    std::vector<KeyListSnapshotEntry> result;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(snapshotFileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_9);
+    quint32 magic = 0, version = 0, count = 0;
+    QByteArray stamp;
+    stream >> magic >> version >> stamp >> count;
+    if (stream.status() != QDataStream::Ok || magic != snapshotMagic || version != snapshotVersion) {
+        qCDebug(KLEOPATRA_LOG) << "Ignoring unreadable key list snapshot";
+        return result;
+    }
+    if (stamp != keyringStamp()) {
+        qCDebug(KLEOPATRA_LOG) << "Ignoring outdated key list snapshot";
+        return result;
+    }
+
+    result.reserve(count);
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        KeyListSnapshotEntry entry;
+        qint32 validity = 0;
+        quint32 flags = 0;
+        stream >> entry.fingerprint >> entry.name >> entry.email >> validity >> flags;
+        entry.validity = validity;
+        entry.flags = flags;
+        result.push_back(entry);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        qCDebug(KLEOPATRA_LOG) << "Ignoring truncated key list snapshot";
+        result.clear();
+        return result;
+    }
+
+    qCDebug(KLEOPATRA_LOG) << "Read key list snapshot with" << result.size()
+                           << "certificates in" << timer.elapsed() << "ms";
+    return result;
+}
+
+void Kleo::saveKeyListSnapshot(const std::vector<GpgME::Key> &keys, bool synchronous)
+{
+    std::vector<KeyListSnapshotEntry> entries;
+    entries.reserve(keys.size());
+    for (const GpgME::Key &key : keys) {
+        entries.push_back(entryFromKey(key));
+    }
+    const QByteArray stamp = keyringStamp();
+    const int generation = latestGeneration.fetchAndAddOrdered(1) + 1;
+
+    if (synchronous) {
+        writeSnapshot(stamp, entries, generation);
+    } else {
+        QThreadPool::globalInstance()->start(new SnapshotWriter(stamp, std::move(entries), generation));
+    }
+}
@@ -0,0 +1,92 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keylistsnapshot.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#ifndef __KLEOPATRA_UTILS_KEYLISTSNAPSHOT_H__
+#define __KLEOPATRA_UTILS_KEYLISTSNAPSHOT_H__
+
+#include <QByteArray>
+#include <QString>
+
+#include <vector>
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+
+/**
+ * The data of one certificate as recorded in the key list snapshot.
+ *
+ * Only what is needed to show the certificate in a list is stored,
+ * i.e. no subkeys, signatures or further user IDs.
+ */
+struct KeyListSnapshotEntry {
+    enum Flag {
+        HasSecret = 0x01,
+        Expired = 0x02,
+        Revoked = 0x04,
+        Disabled = 0x08,
+        Invalid = 0x10,
+        CMS = 0x20
+    };
+
+    QByteArray fingerprint;
+    QString name;
+    QString email;
+    int validity = 0; // GpgME::UserID::Validity of the primary user ID
+    unsigned int flags = 0;
+};
+
+/**
+ * Returns the certificates recorded by the last saveKeyListSnapshot().
+ *
+ * The snapshot is only returned if the keyrings, the trust database
+ * and the trust list have not been modified since it was taken.
+ * Otherwise, or if there is no (readable) snapshot, an empty list is
+ * returned.
+ */
+std::vector<KeyListSnapshotEntry> loadKeyListSnapshot();
+
+/**
+ * Records @p keys together with the current state of the keyring files.
+ *
+ * The data is extracted from @p keys right away. Unless @p synchronous
+ * is true it is written to disk in the background.
+ */
+void saveKeyListSnapshot(const std::vector<GpgME::Key> &keys, bool synchronous = false);
+
+}
+
+#endif // __KLEOPATRA_UTILS_KEYLISTSNAPSHOT_H__
@@ -42,8 +42,9 @@
 
 #include <Libkleo/Exception>
 
+#include <KGuiItem>
 #include <KLocalizedString>
-#include <KMessageBox>
+#include <KStandardGuiItem>
 #include "kleopatra_debug.h"
 
 #include <QFileInfo>
@@ -57,11 +58,16 @@
 #include <QDir>
 #include <QProcess>
 #include <QTimer>
+#include <QEventLoop>
+#include <QMessageBox>
+#include <QPushButton>
 
 #ifdef Q_OS_WIN
 # include <windows.h>
 #endif
 
+#include <vector>
+
 #include <errno.h>
 
 using namespace Kleo;
@@ -73,9 +79,24 @@ static const int PROCESS_TERMINATE_TIMEOUT   = 5 * 1000; // 5s
 class OverwritePolicy::Private
 {
 public:
-    Private(QWidget *p, OverwritePolicy::Policy pol) : policy(pol), widget(p) {}
+    Private(QWidget *p, OverwritePolicy::Policy pol) : policy(pol), widget(p), prompting(false), waiting() {}
+
+    void promptFinished()
+    {
+        prompting = false;
+        const std::vector< QPointer<QEventLoop> > loops = std::move(waiting);
+        waiting.clear();
+        for (const QPointer<QEventLoop> &loop : loops) {
+            if (loop) {
+                loop->quit();
+            }
+        }
+    }
+
     OverwritePolicy::Policy policy;
     QWidget *widget;
+    bool prompting;
+    std::vector< QPointer<QEventLoop> > waiting;
 };
 
 OverwritePolicy::OverwritePolicy(QWidget *parent, Policy initialPolicy) : d(new Private(parent, initialPolicy))
@@ -99,6 +120,51 @@ QWidget *OverwritePolicy::parentWidget() const
     return d->widget;
 }
 
+bool OverwritePolicy::obtainOverwritePermission(const QString &fileName)
+{
+    // Tasks finishing while a prompt is open end up here from within its
+    // event loop; let them wait for the answer instead of stacking prompts.
+    while (d->policy == Ask && d->prompting) {
+        QEventLoop loop;
+        d->waiting.push_back(&loop);
+        loop.exec();
+    }
+    if (d->policy != Ask) {
+        return d->policy == Allow;
+    }
+
+    d->prompting = true;
+    QMessageBox box(QMessageBox::Question, i18n("Overwrite Existing File?"),
+                    i18n("The file <b>%1</b> already exists.\n"
+                         "Overwrite?", fileName),
+                    QMessageBox::NoButton, d->widget);
+    QPushButton *const overwrite = box.addButton(QString(), QMessageBox::YesRole);
+    KGuiItem::assign(overwrite, KStandardGuiItem::overwrite());
+    QPushButton *const overwriteAll = box.addButton(i18n("Overwrite All"), QMessageBox::YesRole);
+    QPushButton *const skip = box.addButton(i18n("Skip"), QMessageBox::NoRole);
+    QPushButton *const skipAll = box.addButton(i18n("Skip All"), QMessageBox::NoRole);
+    box.setDefaultButton(overwrite);
+    box.setEscapeButton(skip);
+
+    // Answer the waiting requests as soon as a button is clicked; the
+    // prompt's exec() only returns once they have been handled.
+    bool allowed = false;
+    QObject::connect(&box, &QMessageBox::buttonClicked, [&](QAbstractButton *button) {
+        allowed = button == overwrite || button == overwriteAll;
+        if (button == overwriteAll) {
+            d->policy = Allow;
+        } else if (button == skipAll) {
+            d->policy = Deny;
+        }
+        d->promptFinished();
+    });
+    box.exec();
+    if (d->prompting) {
+        d->promptFinished();
+    }
+    return allowed;
+}
+
 namespace
 {
 
@@ -537,19 +603,7 @@ FileOutput::FileOutput(const QString &fileName, const std::shared_ptr<OverwriteP
 
 bool FileOutput::obtainOverwritePermission()
 {
-    if (m_policy->policy() != OverwritePolicy::Ask) {
-        return m_policy->policy() == OverwritePolicy::Allow;
-    }
-    const int sel = KMessageBox::questionYesNoCancel(m_policy->parentWidget(), i18n("The file <b>%1</b> already exists.\n"
-                    "Overwrite?", m_fileName),
-                    i18n("Overwrite Existing File?"),
-                    KStandardGuiItem::overwrite(),
-                    KGuiItem(i18n("Overwrite All")),
-                    KStandardGuiItem::cancel());
-    if (sel == KMessageBox::No) { //Overwrite All
-        m_policy->setPolicy(OverwritePolicy::Allow);
-    }
-    return sel == KMessageBox::Yes || sel == KMessageBox::No;
+    return m_policy->obtainOverwritePermission(m_fileName);
 }
 
 void FileOutput::doFinalize()
@@ -65,6 +65,11 @@ public:
 
     QWidget *parentWidget() const;
 
+    /* Asks whether fileName may be overwritten, unless the policy
+     * answers that already. Only one prompt is shown at a time; later
+     * requests wait for it and honor "Overwrite All" and "Skip All". */
+    bool obtainOverwritePermission(const QString &fileName);
+
 private:
     class Private;
     kdtools::pimpl_ptr<Private> d;
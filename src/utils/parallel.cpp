@@ -0,0 +1,94 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/parallel.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include "parallel.h"
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+
+using namespace Kleo;
+
+namespace
+{
+class Worker : public QRunnable
+{
+public:
+    Worker(QAtomicInt &next, int count, const std::function<void(int)> &job)
+        : QRunnable(), m_next(next), m_count(count), m_job(job) {}
+
+    void run() override
+    {
+        for (int i = m_next.fetchAndAddOrdered(1); i < m_count; i = m_next.fetchAndAddOrdered(1)) {
+            m_job(i);
+        }
+    }
+
+private:
+    QAtomicInt &m_next;
+    const int m_count;
+    const std::function<void(int)> &m_job;
+};
+}
+
+int Kleo::defaultParallelism()
+{
+    return std::max(1, QThread::idealThreadCount());
+}
+
+void Kleo::parallelFor(int count, const std::function<void(int)> &job, int maxThreads)
+{
+    if (count <= 0 || !job) {
+        return;
+    }
+    const int threads = std::min(count, maxThreads > 0 ? maxThreads : defaultParallelism());
+    QAtomicInt next(0);
+    if (threads == 1) {
+        Worker(next, count, job).run();
+        return;
+    }
+    // a private pool, so that we neither compete with nor wait for
+    // unrelated work queued on QThreadPool::globalInstance():
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        Worker *const w = new Worker(next, count, job);
+        w->setAutoDelete(true);
+        pool.start(w);
+    }
+    pool.waitForDone();
+}
@@ -43,11 +43,24 @@
 
 #include <QString>
 #include <QStringList>
-#include <QStorageInfo>
+#include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QTemporaryDir>
+#include <QTemporaryFile>
 
 #include <algorithm>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+# include <cerrno>
+# include <cstring>
+# include <stdio.h>
+# include <unistd.h>
+#endif
+#ifdef HAVE_LINUX_SENDFILE
+# include <sys/sendfile.h>
+#endif
 
 using namespace Kleo;
 
@@ -124,7 +137,199 @@ void Kleo::recursivelyRemovePath(const QString &path)
     }
 }
 
-bool Kleo::recursivelyCopy(const QString &src,const QString &dest)
+namespace
+{
+enum { CopyChunkSize = 8 * 1024 * 1024 };
+}
+
+// Copies the rest of @p in to @p out. Tries to let the kernel do the
+// copying and falls back to moving the data through user space. All
+// methods use (and advance) the file offsets, so each one continues
+// where the previous one gave up.
+static bool copyFileData(QFile &in, QFile &out, qint64 &copied, const CopyProgress &progress, QString *errorString)
+{
+#ifdef Q_OS_UNIX
+    const int infd = in.handle();
+    const int outfd = out.handle();
+    ssize_t n = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+    do {
+        n = ::copy_file_range(infd, nullptr, outfd, nullptr, CopyChunkSize, 0);
+        if (n > 0) {
+            copied += n;
+            if (progress && !progress(copied)) {
+                return false;
+            }
+        }
+    } while (n > 0 || (n < 0 && errno == EINTR));
+    if (n == 0) {
+        return true;
+    }
+    qCDebug(KLEOPATRA_LOG) << "copy_file_range failed:" << strerror(errno) << "- trying the next method";
+#endif
+#ifdef HAVE_LINUX_SENDFILE
+    do {
+        n = ::sendfile(outfd, infd, nullptr, CopyChunkSize);
+        if (n > 0) {
+            copied += n;
+            if (progress && !progress(copied)) {
+                return false;
+            }
+        }
+    } while (n > 0 || (n < 0 && errno == EINTR));
+    if (n == 0) {
+        return true;
+    }
+    qCDebug(KLEOPATRA_LOG) << "sendfile failed:" << strerror(errno) << "- trying the next method";
+#endif
+    std::vector<char> buffer(1024 * 1024);
+    Q_FOREVER {
+        n = ::read(infd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            if (errorString) {
+                *errorString = QString::fromLocal8Bit(strerror(errno));
+            }
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        for (ssize_t written = 0; written < n;) {
+            const ssize_t w = ::write(outfd, buffer.data() + written, n - written);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w < 0) {
+                if (errorString) {
+                    *errorString = QString::fromLocal8Bit(strerror(errno));
+                }
+                return false;
+            }
+            written += w;
+        }
+        copied += n;
+        if (progress && !progress(copied)) {
+            return false;
+        }
+    }
+#else
+    std::vector<char> buffer(1024 * 1024);
+    Q_FOREVER {
+        const qint64 n = in.read(buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errorString) {
+                *errorString = in.errorString();
+            }
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        if (out.write(buffer.data(), n) != n) {
+            if (errorString) {
+                *errorString = out.errorString();
+            }
+            return false;
+        }
+        copied += n;
+        if (progress && !progress(copied)) {
+            return false;
+        }
+    }
+#endif
+}
+
+static bool copyFileImpl(const QString &src, const QString &dest, qint64 &copied, const CopyProgress &progress, QString *errorString)
+{
+    QFile in(src);
+    if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        if (errorString) {
+            *errorString = in.errorString();
+        }
+        return false;
+    }
+    QFile out(dest);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        if (errorString) {
+            *errorString = out.errorString();
+        }
+        return false;
+    }
+    if (!copyFileData(in, out, copied, progress, errorString)) {
+        out.close();
+        out.remove();
+        return false;
+    }
+    out.setPermissions(in.permissions());
+    return true;
+}
+
+bool Kleo::copyFile(const QString &src, const QString &dest, QString *errorString, const CopyProgress &progress)
+{
+    qint64 copied = 0;
+    return copyFileImpl(src, dest, copied, progress, errorString);
+}
+
+// rename() that replaces an existing destination in one step where the
+// platform allows it; fails with EXDEV across file systems
+static bool renameReplacing(const QString &src, const QString &dest)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(src).constData(), QFile::encodeName(dest).constData()) == 0;
+#else
+    if (QFileInfo::exists(dest) && !QFile::remove(dest)) {
+        return false;
+    }
+    return QDir().rename(src, dest);
+#endif
+}
+
+static bool moveFileImpl(const QString &src, const QString &dest, qint64 &copied, const CopyProgress &progress, QString *errorString)
+{
+    if (renameReplacing(src, dest)) {
+        copied += QFileInfo(dest).size();
+        if (progress) {
+            progress(copied);
+        }
+        return true;
+    }
+    // Copy next to the destination first, so that nobody ever sees a
+    // half-written file under the final name.
+    const QFileInfo destInfo(dest);
+    QTemporaryFile tmp(destInfo.absolutePath() + QLatin1String("/.") + destInfo.fileName() + QLatin1String(".XXXXXX"));
+    tmp.setAutoRemove(true);
+    if (!tmp.open()) {
+        if (errorString) {
+            *errorString = tmp.errorString();
+        }
+        return false;
+    }
+    const QString tmpName = tmp.fileName();
+    tmp.close();
+    if (!copyFileImpl(src, tmpName, copied, progress, errorString)) {
+        return false;
+    }
+    if (!renameReplacing(tmpName, dest)) {
+        if (errorString) {
+            *errorString = i18n("Cannot rename %1 to %2", tmpName, dest);
+        }
+        return false;
+    }
+    tmp.setAutoRemove(false);
+    QFile::remove(src);
+    return true;
+}
+
+bool Kleo::moveFile(const QString &src, const QString &dest, QString *errorString, const CopyProgress &progress)
+{
+    qint64 copied = 0;
+    return moveFileImpl(src, dest, copied, progress, errorString);
+}
+
+static bool copyTree(const QString &src, const QString &dest, qint64 &copied, const CopyProgress &progress)
 {
     QDir srcDir(src);
 
@@ -140,7 +345,7 @@ bool Kleo::recursivelyCopy(const QString &src,const QString &dest)
     for(const auto file: srcDir.entryList(QDir::Files)) {
         const QString srcName = src + QDir::separator() + file;
         const QString destName = dest + QDir::separator() + file;
-        if(!QFile::copy(srcName, destName)) {
+        if (!copyFileImpl(srcName, destName, copied, progress, nullptr)) {
             return false;
         }
     }
@@ -148,7 +353,7 @@ bool Kleo::recursivelyCopy(const QString &src,const QString &dest)
     for (const auto dir: srcDir.entryList(QDir::AllDirs | QDir::NoDotAndDotDot)) {
         const QString srcName = src + QDir::separator() + dir;
         const QString destName = dest + QDir::separator() + dir;
-        if (!recursivelyCopy(srcName, destName)) {
+        if (!copyTree(srcName, destName, copied, progress)) {
             return false;
         }
     }
@@ -156,16 +361,30 @@ bool Kleo::recursivelyCopy(const QString &src,const QString &dest)
     return true;
 }
 
-bool Kleo::moveDir(const QString &src, const QString &dest)
+bool Kleo::recursivelyCopy(const QString &src, const QString &dest, const CopyProgress &progress)
+{
+    qint64 copied = 0;
+    return copyTree(src, dest, copied, progress);
+}
+
+bool Kleo::moveDir(const QString &src, const QString &dest, const CopyProgress &progress)
 {
-    if (QStorageInfo(src).device() == QStorageInfo(dest).device()) {
-        // Easy same partition we can use qt.
-        return QFile::rename(src, dest);
+    // Easy same partition, a rename is enough.
+    if (QDir().rename(src, dest)) {
+        return true;
+    }
+    // Different partitions. Copy into a temporary directory next to
+    // dest and rename that, so dest appears complete or not at all.
+    const QFileInfo destInfo(dest);
+    QTemporaryDir tmp(destInfo.absolutePath() + QLatin1String("/.") + destInfo.fileName() + QLatin1String(".XXXXXX"));
+    if (!tmp.isValid()) {
+        return false;
     }
-    // first copy
-    if (!recursivelyCopy(src, dest)) {
+    qint64 copied = 0;
+    if (!copyTree(src, tmp.path(), copied, progress) || !QFile::rename(tmp.path(), dest)) {
         return false;
     }
+    tmp.setAutoRemove(false);
     // Then delete original
     recursivelyRemovePath(src);
 
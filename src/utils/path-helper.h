@@ -33,6 +33,10 @@
 #ifndef __KLEOPATRA_UTILS_PATH_HELPER_H__
 #define __KLEOPATRA_UTILS_PATH_HELPER_H__
 
+#include <QtGlobal>
+
+#include <functional>
+
 class QString;
 class QStringList;
 class QDir;
@@ -40,13 +44,25 @@ class QDir;
 namespace Kleo
 {
 
+/* Called with the number of bytes copied so far. Return false to cancel. */
+typedef std::function<bool(qint64)> CopyProgress;
+
 QString heuristicBaseDirectory(const QStringList &files);
 QStringList makeRelativeTo(const QDir &dir, const QStringList &files);
 QStringList makeRelativeTo(const QString &dir, const QStringList &files);
 
 void recursivelyRemovePath(const QString &path);
-bool recursivelyCopy(const QString &src, const QString &dest);
-bool moveDir(const QString &src, const QString &dest);
+bool recursivelyCopy(const QString &src, const QString &dest, const CopyProgress &progress = CopyProgress());
+/* Moves src to dest. Across file systems the data is copied into a
+   temporary directory next to dest first, which is then renamed. */
+bool moveDir(const QString &src, const QString &dest, const CopyProgress &progress = CopyProgress());
+
+/* Copies the contents of src to dest, using kernel-side copying
+   (copy_file_range, sendfile) where available. */
+bool copyFile(const QString &src, const QString &dest, QString *errorString = nullptr, const CopyProgress &progress = CopyProgress());
+/* Moves src to dest, replacing an existing dest atomically. Across file
+   systems the data is copied into a temporary file next to dest first. */
+bool moveFile(const QString &src, const QString &dest, QString *errorString = nullptr, const CopyProgress &progress = CopyProgress());
 }
 
 #endif /* __KLEOPATRA_UTILS_PATH_HELPER_H__ */
@@ -33,16 +33,111 @@
 #include "keycacheoverlay.h"
 
 #include <Libkleo/KeyCache>
+#include <Libkleo/Formatting>
 
 #include "kleopatra_debug.h"
 #include "waitwidget.h"
 
+#include <utils/keylistsnapshot.h>
+
+#include <QAbstractTableModel>
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QSortFilterProxyModel>
+#include <QTreeView>
 #include <QVBoxLayout>
 #include <QEvent>
 #include <KLocalizedString>
 
+#include <gpgme++/key.h>
+
 using namespace Kleo;
 
+namespace
+{
+
+// Read-only list of the certificates of the last session, shown
+// until the key cache has been filled by the live key listing.
+class SnapshotModel : public QAbstractTableModel
+{
+public:
+    enum Column {
+        Name,
+        EMail,
+        Validity,
+        Fingerprint,
+        NumColumns
+    };
+
+    SnapshotModel(std::vector<KeyListSnapshotEntry> &&entries, QObject *parent)
+        : QAbstractTableModel(parent), m_entries(std::move(entries)) {}
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : m_entries.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : NumColumns;
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+            return QVariant();
+        }
+        switch (section) {
+        case Name:        return i18n("Name");
+        case EMail:       return i18n("E-Mail");
+        case Validity:    return i18n("User-IDs");
+        case Fingerprint: return i18n("Fingerprint");
+        }
+        return QVariant();
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || index.row() >= rowCount() || role != Qt::DisplayRole) {
+            return QVariant();
+        }
+        const KeyListSnapshotEntry &entry = m_entries[index.row()];
+        switch (index.column()) {
+        case Name:        return entry.name;
+        case EMail:       return entry.email;
+        case Validity:    return validityText(entry);
+        case Fingerprint: return Formatting::prettyID(entry.fingerprint.constData());
+        }
+        return QVariant();
+    }
+
+private:
+    static QString validityText(const KeyListSnapshotEntry &entry)
+    {
+        if (entry.flags & KeyListSnapshotEntry::Revoked) {
+            return i18n("revoked");
+        }
+        if (entry.flags & KeyListSnapshotEntry::Expired) {
+            return i18n("expired");
+        }
+        if (entry.flags & (KeyListSnapshotEntry::Disabled | KeyListSnapshotEntry::Invalid)) {
+            return i18n("invalid");
+        }
+        switch (entry.validity) {
+        case GpgME::UserID::Ultimate:
+        case GpgME::UserID::Full:
+        case GpgME::UserID::Marginal:
+            return i18n("certified");
+        default:
+            return i18n("not certified");
+        }
+    }
+
+    const std::vector<KeyListSnapshotEntry> m_entries;
+};
+
+}
+
 KeyCacheOverlay::KeyCacheOverlay(QWidget *baseWidget, QWidget *parent)
     : QWidget(parent), mBaseWidget(baseWidget)
 {
@@ -62,6 +157,37 @@ KeyCacheOverlay::KeyCacheOverlay(QWidget *baseWidget, QWidget *parent)
 
     vLay->addWidget(waitWidget);
 
+    // Show the certificates of the last session while we wait, if
+    // the keyrings have not changed since.
+    std::vector<KeyListSnapshotEntry> snapshot = loadKeyListSnapshot();
+    if (!snapshot.empty()) {
+        const int count = snapshot.size();
+        waitWidget->setText(i18np("Loading certificate cache... Showing one certificate from the last session.",
+                                  "Loading certificate cache... Showing %1 certificates from the last session.",
+                                  count));
+
+        auto proxy = new QSortFilterProxyModel(this);
+        proxy->setSourceModel(new SnapshotModel(std::move(snapshot), this));
+        proxy->setFilterKeyColumn(-1);
+        proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+
+        auto filterEdit = new QLineEdit(this);
+        filterEdit->setClearButtonEnabled(true);
+        filterEdit->setPlaceholderText(i18n("Search..."));
+        connect(filterEdit, &QLineEdit::textChanged, proxy, &QSortFilterProxyModel::setFilterFixedString);
+        vLay->addWidget(filterEdit);
+
+        auto view = new QTreeView(this);
+        view->setRootIsDecorated(false);
+        view->setUniformRowHeights(true);
+        view->setSortingEnabled(true);
+        view->setModel(proxy);
+        view->sortByColumn(SnapshotModel::Name, Qt::AscendingOrder);
+        view->header()->setSectionResizeMode(QHeaderView::Interactive);
+        vLay->addWidget(view, 1);
+
+        setAutoFillBackground(true);
+    }
 
     mBaseWidget->installEventFilter(this);
     mBaseWidget->setEnabled(false);
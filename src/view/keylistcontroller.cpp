@@ -38,6 +38,7 @@
 #include <smartcard/readerstatus.h>
 
 #include <utils/action_data.h>
+#include <utils/keylistmodelhelper.h>
 
 #include "tooltippreferences.h"
 #include "kleopatra_debug.h"
@@ -83,8 +84,11 @@
 #include <QPointer>
 #include <QItemSelectionModel>
 #include <QAction>
+#include <QTimer>
 
 #include <algorithm>
+#include <map>
+#include <memory>
 
 using namespace Kleo;
 using namespace Kleo::Commands;
@@ -119,6 +123,7 @@ public:
     {
         view->disconnect(q);
         view->selectionModel()->disconnect(q);
+        selectionCounters.erase(view->selectionModel());
         views.erase(std::remove(views.begin(), views.end(), view), views.end());
     }
 
@@ -128,14 +133,17 @@ public:
         qCDebug(KLEOPATRA_LOG) << (void *)o;
         views.erase(std::remove(views.begin(), views.end(), o), views.end());
         commands.erase(std::remove(commands.begin(), commands.end(), o), commands.end());
+        selectionCounters.erase(static_cast<const QItemSelectionModel *>(o));
     }
     void slotDoubleClicked(const QModelIndex &idx);
     void slotActivated(const QModelIndex &idx);
-    void slotSelectionChanged(const QItemSelection &old, const QItemSelection &new_);
+    void slotSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
+    void slotModelChanged();
     void slotContextMenu(const QPoint &pos);
     void slotCommandFinished();
     void slotAddKey(const Key &key);
     void slotAboutToRemoveKey(const Key &key);
+    void flushPendingRemovals();
     void slotProgress(const QString &what, int current, int total)
     {
         Q_EMIT q->progress(current, total);
@@ -158,9 +166,29 @@ private:
     int toolTipOptions() const;
 
 private:
-    static Command::Restrictions calculateRestrictionsMask(const QItemSelectionModel *sm);
+    Command::Restrictions calculateRestrictionsMask(const QItemSelectionModel *sm) const;
 
 private:
+    // What the restrictions depend on, counted over the selected keys
+    // and updated from the selection changes
+    struct SelectionCounters {
+        SelectionCounters()
+            : dirty(true), keys(0), secret(0), openpgp(0), cms(0),
+              secretOwnerTrustUltimate(0), trustedRoots(0), untrustedRoots(0) {}
+        void add(const Key &key, int delta);
+        Command::Restrictions restrictions() const;
+
+        bool dirty;
+        int keys;
+        int secret;
+        int openpgp;
+        int cms;
+        int secretOwnerTrustUltimate;
+        int trustedRoots;
+        int untrustedRoots;
+    };
+    mutable std::map<const QItemSelectionModel *, SelectionCounters> selectionCounters;
+
     struct action_item {
         QPointer<QAction> action;
         Command::Restrictions restrictions;
@@ -173,6 +201,7 @@ private:
     QPointer<TabWidget> tabWidget;
     QPointer<QAbstractItemView> currentView;
     QPointer<AbstractKeyListModel> flatModel, hierarchicalModel;
+    std::vector<Key> pendingRemovals;
 };
 
 KeyListController::Private::Private(KeyListController *qq)
@@ -183,7 +212,8 @@ KeyListController::Private::Private(KeyListController *qq)
       parentWidget(),
       tabWidget(),
       flatModel(),
-      hierarchicalModel()
+      hierarchicalModel(),
+      pendingRemovals()
 {
     connect(KeyCache::mutableInstance().get(), SIGNAL(added(GpgME::Key)),
             q, SLOT(slotAddKey(GpgME::Key)));
@@ -203,6 +233,7 @@ KeyListController::~KeyListController() {}
 
 void KeyListController::Private::slotAddKey(const Key &key)
 {
+    flushPendingRemovals();
     // ### make model act on keycache directly...
     if (flatModel) {
         flatModel->addKey(key);
@@ -214,13 +245,30 @@ void KeyListController::Private::slotAddKey(const Key &key)
 
 void KeyListController::Private::slotAboutToRemoveKey(const Key &key)
 {
-    // ### make model act on keycache directly...
-    if (flatModel) {
-        flatModel->removeKey(key);
+    // The key cache announces removals one key at a time. Collect them
+    // and update the models once control returns to the event loop, so
+    // that the views are not repainted between the removals of a batch.
+    if (pendingRemovals.empty()) {
+        QTimer::singleShot(0, q, [this]() { flushPendingRemovals(); });
     }
-    if (hierarchicalModel) {
-        hierarchicalModel->removeKey(key);
+    pendingRemovals.push_back(key);
+}
+
+void KeyListController::Private::flushPendingRemovals()
+{
+    if (pendingRemovals.empty()) {
+        return;
     }
+    std::vector<Key> keys;
+    keys.swap(pendingRemovals);
+    std::unique_ptr<SortFilterSuspender> suspender;
+    if (keys.size() > 1) {
+        // refilter the views once for the batch, not once per key
+        suspender.reset(new SortFilterSuspender(views));
+    }
+    // ### make model act on keycache directly...
+    removeKeysFromModel(flatModel, keys);
+    removeKeysFromModel(hierarchicalModel, keys);
 }
 
 void KeyListController::addView(QAbstractItemView *view)
@@ -599,6 +647,16 @@ void KeyListController::Private::connectView(QAbstractItemView *view)
             q, SLOT(slotActivated(QModelIndex)));
     connect(view->selectionModel(), SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
             q, SLOT(slotSelectionChanged(QItemSelection,QItemSelection)));
+    connect(view->selectionModel(), SIGNAL(destroyed(QObject*)),
+            q, SLOT(slotDestroyed(QObject*)));
+
+    // The counted keys may change or go away without a selection change
+    if (const QAbstractItemModel *const model = view->model()) {
+        connect(model, SIGNAL(modelReset()), q, SLOT(slotModelChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(layoutChanged()), q, SLOT(slotModelChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), q, SLOT(slotModelChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), q, SLOT(slotModelChanged()), Qt::UniqueConnection);
+    }
 
     view->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(view, SIGNAL(customContextMenuRequested(QPoint)),
@@ -643,18 +701,43 @@ void KeyListController::Private::slotActivated(const QModelIndex &idx)
 
 }
 
-void KeyListController::Private::slotSelectionChanged(const QItemSelection &old, const QItemSelection &new_)
+void KeyListController::Private::slotSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
 {
-    Q_UNUSED(old);
-    Q_UNUSED(new_);
-
     const QItemSelectionModel *const sm = qobject_cast<QItemSelectionModel *>(q->sender());
     if (!sm) {
         return;
     }
+
+    SelectionCounters &counters = selectionCounters[sm];
+    const KeyListModelInterface *const m = dynamic_cast<const KeyListModelInterface *>(sm->model());
+    if (m && !counters.dirty) {
+        // Count each row once, through the range holding its first column
+        const auto apply = [m, &counters](const QItemSelection &selection, int delta) {
+            for (const QItemSelectionRange &range : selection) {
+                if (range.left() != 0) {
+                    continue;
+                }
+                for (int row = range.top(); row <= range.bottom(); ++row) {
+                    counters.add(m->key(range.model()->index(row, 0, range.parent())), delta);
+                }
+            }
+        };
+        apply(deselected, -1);
+        apply(selected, +1);
+    }
     q->enableDisableActions(sm);
 }
 
+void KeyListController::Private::slotModelChanged()
+{
+    const QObject *const model = q->sender();
+    for (auto &it : selectionCounters) {
+        if (it.first->model() == model) {
+            it.second.dirty = true;
+        }
+    }
+}
+
 void KeyListController::Private::slotContextMenu(const QPoint &p)
 {
     QAbstractItemView *const view = qobject_cast<QAbstractItemView *>(q->sender());
@@ -686,80 +769,95 @@ void KeyListController::enableDisableActions(const QItemSelectionModel *sm) cons
         }
 }
 
-static bool all_secret_are_not_owner_trust_ultimate(const std::vector<Key> &keys)
-{
-    for (const Key &key : keys)
-        if (key.hasSecret() && key.ownerTrust() == Key::Ultimate) {
-            return false;
-        }
-    return true;
-}
-
-Command::Restrictions find_root_restrictions(const std::vector<Key> &keys)
+void KeyListController::Private::SelectionCounters::add(const Key &key, int delta)
 {
-    bool trusted = false, untrusted = false;
-    for (const Key &key : keys)
-        if (key.isRoot())
-            if (key.userID(0).validity() == UserID::Ultimate) {
-                trusted = true;
-            } else {
-                untrusted = true;
-            }
-        else {
-            return Command::NoRestriction;
+    if (key.isNull()) {
+        return;
+    }
+    keys += delta;
+    if (key.hasSecret()) {
+        secret += delta;
+        if (key.ownerTrust() == Key::Ultimate) {
+            secretOwnerTrustUltimate += delta;
         }
-    if (trusted)
-        if (untrusted) {
-            return Command::NoRestriction;
+    }
+    if (key.protocol() == OpenPGP) {
+        openpgp += delta;
+    } else if (key.protocol() == CMS) {
+        cms += delta;
+    }
+    if (key.isRoot()) {
+        if (key.userID(0).validity() == UserID::Ultimate) {
+            trustedRoots += delta;
         } else {
-            return Command::MustBeTrustedRoot;
+            untrustedRoots += delta;
         }
-    else if (untrusted) {
-        return Command::MustBeUntrustedRoot;
-    } else {
-        return Command::NoRestriction;
     }
 }
 
-Command::Restrictions KeyListController::Private::calculateRestrictionsMask(const QItemSelectionModel *sm)
+Command::Restrictions KeyListController::Private::SelectionCounters::restrictions() const
 {
-    if (!sm) {
-        return nullptr;
-    }
-
-    const KeyListModelInterface *const m = dynamic_cast<const KeyListModelInterface *>(sm->model());
-    if (!m) {
-        return nullptr;
-    }
-
-    const std::vector<Key> keys = m->keys(sm->selectedRows());
-    if (keys.empty()) {
+    if (keys <= 0) {
         return nullptr;
     }
 
     Command::Restrictions result = Command::NeedSelection;
 
-    if (keys.size() == 1) {
+    if (keys == 1) {
         result |= Command::OnlyOneKey;
     }
 
-    if (std::all_of(keys.cbegin(), keys.cend(), std::mem_fn(&Key::hasSecret))) {
+    if (secret == keys) {
         result |= Command::NeedSecretKey;
-    } else if (!std::any_of(keys.cbegin(), keys.cend(), std::mem_fn(&Key::hasSecret))) {
+    } else if (secret == 0) {
         result |= Command::MustNotBeSecretKey;
     }
 
-    if (std::all_of(keys.cbegin(), keys.cend(), [](const Key &key) { return key.protocol() == OpenPGP; })) {
+    if (openpgp == keys) {
         result |= Command::MustBeOpenPGP;
-    } else if (std::all_of(keys.cbegin(), keys.cend(), [](const Key &key) { return key.protocol() == CMS; })) {
+    } else if (cms == keys) {
         result |= Command::MustBeCMS;
     }
 
-    if (all_secret_are_not_owner_trust_ultimate(keys)) {
+    if (secretOwnerTrustUltimate == 0) {
         result |= Command::MayOnlyBeSecretKeyIfOwnerTrustIsNotYetUltimate;
     }
 
-    result |= find_root_restrictions(keys);
+    if (trustedRoots + untrustedRoots == keys) {
+        if (untrustedRoots == 0) {
+            result |= Command::MustBeTrustedRoot;
+        } else if (trustedRoots == 0) {
+            result |= Command::MustBeUntrustedRoot;
+        }
+    }
+
+    return result;
+}
+
+Command::Restrictions KeyListController::Private::calculateRestrictionsMask(const QItemSelectionModel *sm) const
+{
+    if (!sm) {
+        return nullptr;
+    }
+
+    const KeyListModelInterface *const m = dynamic_cast<const KeyListModelInterface *>(sm->model());
+    if (!m) {
+        return nullptr;
+    }
+
+    SelectionCounters &counters = selectionCounters[sm];
+    if (counters.dirty) {
+        counters = SelectionCounters();
+        for (const Key &key : m->keys(sm->selectedRows())) {
+            counters.add(key, 1);
+        }
+        counters.dirty = false;
+    }
+
+    Command::Restrictions result = counters.restrictions();
+    if (!result) {
+        return result;
+    }
 
     if (const ReaderStatus *rs = ReaderStatus::instance()) {
         if (rs->anyCardHasNullPin()) {
@@ -124,6 +124,7 @@ private:
     Q_PRIVATE_SLOT(d, void slotDoubleClicked(QModelIndex))
     Q_PRIVATE_SLOT(d, void slotActivated(QModelIndex))
     Q_PRIVATE_SLOT(d, void slotSelectionChanged(QItemSelection, QItemSelection))
+    Q_PRIVATE_SLOT(d, void slotModelChanged())
     Q_PRIVATE_SLOT(d, void slotContextMenu(QPoint))
     Q_PRIVATE_SLOT(d, void slotCommandFinished())
     Q_PRIVATE_SLOT(d, void slotAddKey(GpgME::Key))
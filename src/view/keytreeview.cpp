@@ -40,6 +40,7 @@
 #include <Libkleo/Predicates>
 
 #include <utils/headerview.h>
+#include <utils/keylistmodelhelper.h>
 
 #include <Libkleo/Stl_Util>
 #include <Libkleo/KeyFilter>
@@ -51,6 +52,8 @@
 #include <QItemSelection>
 #include <QLayout>
 
+#include <algorithm>
+
 
 using namespace Kleo;
 using namespace GpgME;
@@ -344,17 +347,120 @@ void KeyTreeView::setKeys(const std::vector<Key> &keys)
     std::vector<Key> sorted = keys;
     _detail::sort_by_fpr(sorted);
     _detail::remove_duplicates_by_fpr(sorted);
-    m_keys = sorted;
-    if (m_flatModel) {
-        m_flatModel->setKeys(sorted);
+
+    if (m_keys.empty() || sorted.empty()) {
+        // nothing to diff against, a reset is cheapest
+        m_keys = sorted;
+        if (m_flatModel) {
+            m_flatModel->setKeys(sorted);
+        }
+        if (m_hierarchicalModel) {
+            m_hierarchicalModel->setKeys(sorted);
+        }
+        if (!sorted.empty()) {
+            resizeColumnsToSample();
+        }
+        return;
     }
-    if (m_hierarchicalModel) {
-        m_hierarchicalModel->setKeys(sorted);
+
+    // Both lists are sorted by fingerprint: walk them in parallel and
+    // only pass on what was removed, added or changed.
+    _detail::ByFingerprint<std::less> less;
+    std::vector<Key> removed, addedOrChanged;
+    auto oldIt = m_keys.cbegin();
+    auto newIt = sorted.cbegin();
+    while (oldIt != m_keys.cend() || newIt != sorted.cend()) {
+        if (newIt == sorted.cend() || (oldIt != m_keys.cend() && less(*oldIt, *newIt))) {
+            removed.push_back(*oldIt++);
+        } else if (oldIt == m_keys.cend() || less(*newIt, *oldIt)) {
+            addedOrChanged.push_back(*newIt++);
+        } else {
+            // a new listing of the same key: the model must hold the
+            // new version (and tell views about it), even if nothing
+            // visible changed, or it would hand out stale key data
+            if (oldIt->impl() != newIt->impl()) {
+                addedOrChanged.push_back(*newIt);
+            }
+            ++oldIt;
+            ++newIt;
+        }
+    }
+    qCDebug(KLEOPATRA_LOG) << "KeyTreeView::setKeys:" << removed.size() << "removed,"
+                           << addedOrChanged.size() << "added or changed of" << sorted.size();
+
+    m_keys.swap(sorted);
+
+    if (2 * (removed.size() + addedOrChanged.size()) > m_keys.size()) {
+        // Most keys changed, e.g. because the key cache was reloaded and
+        // every key is a new listing. One reset is much cheaper than a
+        // dataChanged() per row; keep the selection across it.
+        const std::vector<Key> selectedKeys = this->selectedKeys();
+        const Key currentKey = m_proxy->key(m_view->currentIndex());
+        if (m_flatModel) {
+            m_flatModel->setKeys(m_keys);
+        }
+        if (m_hierarchicalModel) {
+            m_hierarchicalModel->setKeys(m_keys);
+        }
+        if (m_isHierarchical) {
+            m_view->expandAll();
+        }
+        selectKeys(selectedKeys);
+        if (!currentKey.isNull()) {
+            const QModelIndex currentIndex = m_proxy->index(currentKey);
+            if (currentIndex.isValid()) {
+                m_view->selectionModel()->setCurrentIndex(currentIndex, QItemSelectionModel::NoUpdate);
+            }
+        }
+        return;
+    }
+
+    if (!removed.empty()) {
+        const SortFilterSuspender suspender(std::vector<QAbstractItemView *>(1, m_view));
+        removeKeysFromModel(m_flatModel, removed);
+        removeKeysFromModel(m_hierarchicalModel, removed);
     }
-    if (!sorted.empty())
-        if (QHeaderView *const hv = m_view ? m_view->header() : nullptr) {
-            hv->resizeSections(QHeaderView::ResizeToContents);
+    if (!addedOrChanged.empty()) {
+        // addKeys() replaces keys that are already in the model
+        if (m_flatModel) {
+            m_flatModel->addKeys(addedOrChanged);
         }
+        if (m_hierarchicalModel) {
+            m_hierarchicalModel->addKeys(addedOrChanged);
+        }
+    }
+}
+
+void KeyTreeView::resizeColumnsToSample()
+{
+    // Measuring every row (QHeaderView::ResizeToContents) takes seconds
+    // for large keyrings, so only look at rows spread evenly across the
+    // model.
+    static const int maxSampleRows = 200;
+
+    QHeaderView *const hv = m_view ? m_view->header() : nullptr;
+    const QAbstractItemModel *const model = m_view ? m_view->model() : nullptr;
+    if (!hv || !model) {
+        return;
+    }
+    const int rows = model->rowCount();
+    if (rows <= 0) {
+        return;
+    }
+    const int step = std::max(1, rows / maxSampleRows);
+    for (int column = 0, columns = model->columnCount(); column < columns; ++column) {
+        if (hv->isSectionHidden(column)) {
+            continue;
+        }
+        int width = hv->sectionSizeHint(column);
+        for (int row = 0; row < rows; row += step) {
+            width = std::max(width, m_view->sizeHintForIndex(model->index(row, column)).width());
+        }
+        if (column == 0 && m_view->rootIsDecorated()) {
+            width += m_view->indentation();
+        }
+        hv->resizeSection(column, width);
+    }
 }
 
 void KeyTreeView::addKeysImpl(const std::vector<Key> &keys, bool select)
@@ -412,15 +518,9 @@ void KeyTreeView::removeKeys(const std::vector<Key> &keys)
                         _detail::ByFingerprint<std::less>());
     m_keys.swap(newKeys);
 
-    if (m_flatModel) {
-        std::for_each(sorted.cbegin(), sorted.cend(),
-                      [this](const Key &key) { m_flatModel->removeKey(key); });
-    }
-    if (m_hierarchicalModel) {
-        std::for_each(sorted.cbegin(), sorted.cend(),
-                      [this](const Key &key) { m_hierarchicalModel->removeKey(key); });
-    }
-
+    const SortFilterSuspender suspender(std::vector<QAbstractItemView *>(1, m_view));
+    removeKeysFromModel(m_flatModel, sorted);
+    removeKeysFromModel(m_hierarchicalModel, sorted);
 }
 
 static const struct {
@@ -145,6 +145,7 @@ protected:
 private:
     void init();
     void addKeysImpl(const std::vector<GpgME::Key> &, bool);
+    void resizeColumnsToSample();
 
 private:
     std::vector<GpgME::Key> m_keys;
@@ -0,0 +1,206 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    tests/bench_kdpipeiodevice.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    Copyright (c) 2018 Intevation GmbH
+
+    Kleopatra is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kleopatra is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+    In addition, as a special exception, the copyright holders give
+    permission to link the code of this program with any edition of
+    the Qt library by Trolltech AS, Norway (or with modified versions
+    of Qt that use the same license as Qt), and distribute linked
+    combinations including the two.  You must obey the GNU General
+    Public License in all respects for all of the code used other than
+    Qt.  If you modify this file, you may extend this exception to
+    your version of the file, but you are not obligated to do so.  If
+    you do not wish to do so, delete this exception statement from
+    your version.
+*/
+
+#include <config-kleopatra.h>
+
+#include <utils/kdpipeiodevice.h>
+
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QTest>
+
+#include <thread>
+
+#include <unistd.h>
+#include <errno.h>
+
+// Measures the throughput of KDPipeIODevice in both directions for a
+// range of buffer sizes, and checks that the data arrives unmodified.
+
+static const qint64 PAYLOAD_SIZE = 256 * 1024 * 1024;
+static const int CHUNK_SIZE = 64 * 1024; // what QGpgME's data providers use, roughly
+
+static QByteArray make_chunk()
+{
+    QByteArray chunk(CHUNK_SIZE, Qt::Uninitialized);
+    for (int i = 0; i < chunk.size(); ++i) {
+        chunk[i] = static_cast<char>(i * 131 % 251);
+    }
+    return chunk;
+}
+
+static bool write_all(int fd, const char *data, qint64 size)
+{
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+class KDPipeIODeviceBenchmark : public QObject
+{
+    Q_OBJECT
+private:
+    void addBufferSizes()
+    {
+        QTest::addColumn<unsigned int>("bufferSize");
+        QTest::newRow("4KiB") << 4096U;
+        QTest::newRow("64KiB") << 64U * 1024;
+        QTest::newRow("256KiB") << 256U * 1024;
+        QTest::newRow("1MiB") << 1024U * 1024;
+    }
+
+    static void report(const char *what, qint64 bytes, qint64 ms)
+    {
+        const double mbps = ms ? bytes / 1000.0 / ms : 0;
+        qDebug("%s: %.1f MB/s (buffer size %u)", what, mbps, KDPipeIODevice::bufferSize());
+        QTest::setBenchmarkResult(ms ? bytes * 1000.0 / ms : 0, QTest::BytesPerSecond);
+    }
+
+private Q_SLOTS:
+    void benchmarkRead_data()
+    {
+        addBufferSizes();
+    }
+
+    void benchmarkRead()
+    {
+        QFETCH(unsigned int, bufferSize);
+        KDPipeIODevice::setBufferSize(bufferSize);
+
+        int fds[2];
+        QVERIFY(::pipe(fds) == 0);
+
+        const QByteArray chunk = make_chunk();
+        QCryptographicHash sent(QCryptographicHash::Sha1);
+        std::thread producer([&]() {
+            for (qint64 done = 0; done < PAYLOAD_SIZE; done += chunk.size()) {
+                sent.addData(chunk);
+                if (!write_all(fds[1], chunk.constData(), chunk.size())) {
+                    break;
+                }
+            }
+            ::close(fds[1]);
+        });
+
+        KDPipeIODevice device(fds[0], QIODevice::ReadOnly);
+        QCryptographicHash received(QCryptographicHash::Sha1);
+        QByteArray buffer(CHUNK_SIZE, Qt::Uninitialized);
+        qint64 total = 0;
+
+        QElapsedTimer timer;
+        timer.start();
+        while (true) {
+            const qint64 n = device.read(buffer.data(), buffer.size());
+            if (n <= 0) {
+                break;
+            }
+            received.addData(buffer.constData(), n);
+            total += n;
+        }
+        const qint64 elapsed = timer.elapsed();
+        producer.join();
+        device.close();
+
+        QCOMPARE(total, PAYLOAD_SIZE);
+        QCOMPARE(received.result(), sent.result());
+        report("read", total, elapsed);
+    }
+
+    void benchmarkWrite_data()
+    {
+        addBufferSizes();
+    }
+
+    void benchmarkWrite()
+    {
+        QFETCH(unsigned int, bufferSize);
+        KDPipeIODevice::setBufferSize(bufferSize);
+
+        int fds[2];
+        QVERIFY(::pipe(fds) == 0);
+
+        QCryptographicHash received(QCryptographicHash::Sha1);
+        qint64 total = 0;
+        std::thread consumer([&]() {
+            QByteArray buffer(CHUNK_SIZE, Qt::Uninitialized);
+            while (true) {
+                const ssize_t n = ::read(fds[0], buffer.data(), buffer.size());
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                received.addData(buffer.constData(), n);
+                total += n;
+            }
+            ::close(fds[0]);
+        });
+
+        const QByteArray chunk = make_chunk();
+        QCryptographicHash sent(QCryptographicHash::Sha1);
+        KDPipeIODevice device(fds[1], QIODevice::WriteOnly);
+
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = true;
+        for (qint64 done = 0; ok && done < PAYLOAD_SIZE; done += chunk.size()) {
+            sent.addData(chunk);
+            for (qint64 written = 0; ok && written < chunk.size();) {
+                const qint64 n = device.write(chunk.constData() + written, chunk.size() - written);
+                ok = n > 0;
+                written += n;
+            }
+        }
+        device.close(); // flushes and closes fds[1]
+        consumer.join();
+        const qint64 elapsed = timer.elapsed();
+
+        QVERIFY(ok);
+        QCOMPARE(total, PAYLOAD_SIZE);
+        QCOMPARE(received.result(), sent.result());
+        report("write", total, elapsed);
+    }
+};
+
+QTEST_GUILESS_MAIN(KDPipeIODeviceBenchmark)
+
+#include "bench_kdpipeiodevice.moc"